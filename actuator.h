@@ -0,0 +1,43 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   actuator.h                                 */
+/*  File Contents:          Actuator command hand-off                  */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+motor_output() and handle() only fill in the next actuator command,
+actuator_commit() hands the complete command over at the end of a
+control step. The GPT1 period interrupt (motor PWM cycle end) puts it
+out: both duties into the GPT1/GPT2 GTCCRC buffers and the servo count
+into the MTU3.TGRD buffer. The hardware moves the duties into GTCCRA
+at the next cycle end, the interrupt of that cycle end switches the
+direction signals, so left and right duty and direction always change
+together, in one motor PWM period.
+
+A command that is replaced by the next commit before the interrupt
+took it counts in actuatorStats.overwritten: the control loop outruns
+the actuators. actuatorStats can be read with the debugger on target
+and by the host tools.
+**/
+
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+#include "hal.h"
+#include "odometry.h"
+
+struct actuator_cmd {
+	unsigned short duty[WHEELS];	// GPT1/GPT2 GTCCRC count
+	unsigned char reverse;			// bit 0: left, bit 1: right
+	unsigned short servo;			// MTU3.TGRD count
+};
+
+struct actuator_stats {
+	unsigned long commits;		// commands handed over
+	unsigned long applied;		// commands put out by the interrupt
+	unsigned long overwritten;	// commands replaced before they were put out
+};
+
+extern HAL_STATE struct actuator_stats actuatorStats;
+
+#endif /* ACTUATOR_H */
@@ -0,0 +1,34 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   control.h                                  */
+/*  File Contents:          Fixed rate control loop statistics         */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+main() runs one control step (sensor_sample() and state_step()) every
+CONTROL_PERIOD_MS CMT0 interrupts and sleeps in between. Every step is
+timed with timestamp() (CMT2), a step that is still running when the
+next one is due is a deadline miss. controlStats can be read with the
+debugger on target and by the host tools.
+
+Times are in timestamp() counts, HAL_HIRES_HZ.
+**/
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "hal.h"
+
+struct control_stats {
+	unsigned long period;		// control period
+	unsigned long steps;		// control steps run
+	unsigned long misses;		// steps longer than the period
+	unsigned long skipped;		// periods without a step, lost to misses
+	unsigned long idle;			// sum of the time left in each period
+	unsigned short last;		// execution time of the last step
+	unsigned short wcet;		// longest execution time
+};
+
+extern HAL_STATE struct control_stats controlStats;
+
+#endif /* CONTROL_H */
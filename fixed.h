@@ -0,0 +1,89 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   fixed.h                                    */
+/*  File Contents:          Q16.16 fixed point arithmetic              */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+The RX62T FPU only does single precision, every double operation in
+the control path is a runtime library call. The control code uses
+Q16.16 fixed point instead: a fx_t holds value * 65536 in 32 bits,
+range -32768 to 32767.99998, resolution 0.0000153.
+
+All helpers saturate instead of wrapping and convert to int by
+truncating toward zero, like the (int) conversion of a double.
+
+Tolerance against the double code it replaced: a constant is off by at
+most one LSB, so a product with an int n is off by at most n / 65536.
+FX_RATIO() rounds up, so whole-percent factors applied to -100..100
+give exactly the truncated decimal result (where double sometimes
+landed just below, e.g. 90 * 0.7 = 62.999..).
+
+Notation:
+*  FX(x)               constant from a literal, rounded to nearest
+*  FX_RATIO(num, den)  constant num/den from integers, rounded up
+*  fx_from_int(i)      int -> fx_t
+*  fx_to_int(x)        fx_t -> int, toward zero
+*  fx_mul(a, b)        a * b
+*  fx_mul_int(a, i)    a * i as int, toward zero
+*  fx_div_int(i, d)    i / d as fx_t, FX_MAX for d == 0
+**/
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+
+typedef int32_t fx_t;
+
+#define FX_SHIFT		16
+#define FX_ONE			((fx_t)1 << FX_SHIFT)
+#define FX_MAX			((fx_t)INT32_MAX)
+#define FX_MIN			((fx_t)INT32_MIN)
+
+/* Compile time constants only, the double literal never reaches code */
+#define FX(x)				((fx_t)((x) * FX_ONE + ((x) >= 0 ? 0.5 : -0.5)))
+#define FX_RATIO(num, den)	((fx_t)((((int64_t)(num) << FX_SHIFT) + (den) - 1) / (den)))
+
+static inline fx_t fx_sat(int64_t v)
+{
+	if (v > FX_MAX) {
+		return FX_MAX;
+	}
+	if (v < FX_MIN) {
+		return FX_MIN;
+	}
+	return (fx_t)v;
+}
+
+static inline fx_t fx_from_int(int i)
+{
+	return fx_sat((int64_t)i << FX_SHIFT);
+}
+
+static inline int fx_to_int(fx_t x)
+{
+	return (x >= 0) ? (int)(x >> FX_SHIFT) : -(int)(-(int64_t)x >> FX_SHIFT);
+}
+
+static inline fx_t fx_mul(fx_t a, fx_t b)
+{
+	int64_t p = (int64_t)a * b;
+
+	return fx_sat(p >= 0 ? p >> FX_SHIFT : -(-p >> FX_SHIFT));
+}
+
+static inline int fx_mul_int(fx_t a, int i)
+{
+	return fx_to_int(fx_sat((int64_t)a * i));
+}
+
+static inline fx_t fx_div_int(int i, int d)
+{
+	if (d == 0) {
+		return i >= 0 ? FX_MAX : FX_MIN;
+	}
+	return fx_sat(((int64_t)i << FX_SHIFT) / d);
+}
+
+#endif /* FIXED_H */
@@ -0,0 +1,77 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   hal.h                                      */
+/*  File Contents:          Hardware abstraction layer (backend select)*/
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+The control code in kit12_rx62t.c never touches a register directly,
+it only calls the static inline hal_* functions declared by one of the
+backends below:
+
+* hal_rx62t.h  RMC-RX62T board, accesses the iodefine.h registers
+* hal_host.h   Linux build hosts (gcc/clang), plain memory in hal_host
+
+The backend is selected at compile time, HAL_HOST selects the host one.
+All functions are static inline, so on target every call compiles to
+the same register access the firmware did before.
+
+HAL function overview:
+*  hal_init(pwm_cycle, servo_center,   clock, ports, CMT0-CMT2, MTU1/MTU2
+*           motor_cycle)                encoders, MTU3/MTU4 servo PWM,
+*                                       GPT1/GPT2 motor PWM, GPT1 period
+*                                       interrupt (GTCIV1)
+*  hal_sensor_read()                    line sensors, 1: line detected
+*  hal_startbar_read()                  1: start bar present
+*  hal_dipsw_read()                     DIP switch, 0 to 15
+*  hal_buttonsw_read()                  MCU board push-button, 1: ON
+*  hal_pushsw_read()                    motor drive board push-button, 1: ON
+*  hal_led_m_write(led)                 MCU board LEDs, 1: lit
+*  hal_led_write(led)                   motor drive board LEDs, 1: lit
+*  hal_motor_duty(left, right)          motor PWM counts, from the next
+*                                       GPT1/GPT2 cycle end on
+*  hal_motor_dir(reverse)               both direction signals, bit 0 left
+*  hal_servo_write(count)               servo PWM count
+*  hal_encoder_left(), _right()         16 bit wheel encoder count,
+*                                       forward counts up
+*  hal_analog_init(a)                   S12AD0/S12AD1 line sensor scans,
+*                                       DTC into the ring in *a
+*  hal_analog_rearm(a, unit)            restart a full ring, from the
+*                                       S12ADI0/S12ADI1 interrupt
+*  hal_analog_read(a, raw)              latest scan, 0 to HAL_ANALOG_MAX
+*                                       per sensor, 0: brightest
+*  hal_tick_count()                     time since the last CMT0 interrupt,
+*                                       HAL_TICK_COUNTS per period
+*  hal_tick_pending()                   CMT0 interrupt raised, not serviced
+*  hal_hires_count()                    free running 16 bit counter,
+*                                       HAL_HIRES_HZ
+*  hal_hires_pending()                  its wrap interrupt raised, not serviced
+*  hal_wait_interrupt()                 sleep until the next interrupt
+*  hal_disable_interrupts()             mask all interrupts (PSW.I)
+*  hal_enable_interrupts()              unmask them again
+
+Storage classes for the control code:
+*  HAL_STATE     global state, one copy per thread on the host so
+*                several emulated cars can run side by side
+*  HAL_TUNABLE   tuning tables, const (ROM) on target, writable
+*                HAL_STATE on the host
+**/
+
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef __RX
+#define HAL_STATE
+#define HAL_TUNABLE		const
+#else
+#define HAL_STATE		_Thread_local
+#define HAL_TUNABLE		HAL_STATE
+#endif
+
+#ifdef HAL_HOST
+#include "hal_host.h"
+#else
+#include "hal_rx62t.h"
+#endif
+
+#endif /* HAL_H */
@@ -0,0 +1,194 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   hal_host.h                                 */
+/*  File Contents:          Hardware abstraction layer, host backend   */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Same interface as hal_rx62t.h, but every input and output is a plain
+* field of hal_host so the control code can be built with gcc/clang and
+* driven or inspected by host programs. Logic levels are already
+* converted: 1 means line detected / switch ON / LED lit.
+* Storage for hal_host lives in host/hal_host.c.
+**/
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#define HAL_TICK_COUNTS		97		// same timebase as the RX62T backend
+#define HAL_TICK_COUNT_NS	10417
+#define HAL_HIRES_HZ		6144000UL
+#define HAL_SAMPLE_COUNTS	614
+#define HAL_SAMPLE_HZ		10000
+#define HAL_SERVO_HZ		1536000UL
+#define HAL_ANALOG_CHANNELS	8
+#define HAL_ANALOG_MAX		4095
+
+/* Nothing to keep, hal_analog_read() copies hal_host.analog */
+struct hal_analog {
+	unsigned char running;
+};
+
+struct hal_host_io {
+	/* Inputs, written by the host program */
+	unsigned char sensor;               // bit 7: leftmost .. bit 0: rightmost
+	unsigned char startbar;             // 1: bar present
+	unsigned char dipsw;                // 0 to 15
+	unsigned char buttonsw;             // 1: ON
+	unsigned char pushsw;               // 1: ON
+	unsigned short tick_count;          // 0 to HAL_TICK_COUNTS - 1
+	unsigned short hires_count;         // HAL_HIRES_HZ, free running
+	unsigned short encoder_left;        // wheel encoder counts
+	unsigned short encoder_right;
+	unsigned short analog[HAL_ANALOG_CHANNELS];	// bit order of sensor, 0: brightest
+
+	/* Outputs, written by the control code */
+	unsigned char led_m;                // MCU board LEDs
+	unsigned char led;                  // motor drive board LEDs
+	unsigned char motor_reverse;        // bit 0: left, bit 1: right
+	unsigned short motor_left;          // PWM count
+	unsigned short motor_right;         // PWM count
+	unsigned short servo;               // PWM count
+	unsigned short pwm_cycle;           // set by hal_init(), servo
+	unsigned short motor_cycle;         // set by hal_init(), motors
+
+	/* Optional, called by hal_wait_interrupt(): the host program lets
+	   time pass and runs the interrupt handlers that are due */
+	void (*wait_fn)(void *ctx);
+	void *wait_ctx;
+};
+
+extern HAL_STATE struct hal_host_io hal_host;
+
+static inline void hal_init(unsigned short pwm_cycle, unsigned short servo_center,
+							unsigned short motor_cycle)
+{
+	hal_host.pwm_cycle = pwm_cycle;
+	hal_host.motor_cycle = motor_cycle;
+	hal_host.servo = servo_center;
+	hal_host.motor_left = 0;
+	hal_host.motor_right = 0;
+	hal_host.motor_reverse = 0;
+	hal_host.led_m = 0;
+	hal_host.led = 0;
+}
+
+static inline unsigned char hal_sensor_read(void)
+{
+	return hal_host.sensor;
+}
+
+static inline unsigned char hal_startbar_read(void)
+{
+	return hal_host.startbar & 0x01;
+}
+
+static inline unsigned char hal_dipsw_read(void)
+{
+	return hal_host.dipsw & 0x0f;
+}
+
+static inline unsigned char hal_buttonsw_read(void)
+{
+	return hal_host.buttonsw & 0x01;
+}
+
+static inline unsigned char hal_pushsw_read(void)
+{
+	return hal_host.pushsw & 0x01;
+}
+
+static inline void hal_led_m_write(unsigned char led)
+{
+	hal_host.led_m = led & 0x0f;
+}
+
+static inline void hal_led_write(unsigned char led)
+{
+	hal_host.led = led & 0x03;
+}
+
+static inline void hal_motor_duty(unsigned short left, unsigned short right)
+{
+	hal_host.motor_left = left;
+	hal_host.motor_right = right;
+}
+
+static inline void hal_motor_dir(unsigned char reverse)
+{
+	hal_host.motor_reverse = reverse & 0x03;
+}
+
+static inline void hal_servo_write(unsigned short count)
+{
+	hal_host.servo = count;
+}
+
+static inline unsigned short hal_encoder_left(void)
+{
+	return hal_host.encoder_left;
+}
+
+static inline unsigned short hal_encoder_right(void)
+{
+	return hal_host.encoder_right;
+}
+
+static inline void hal_analog_init(struct hal_analog *a)
+{
+	a->running = 1;
+}
+
+static inline void hal_analog_rearm(struct hal_analog *a, int unit)
+{
+	(void)a;
+	(void)unit;
+}
+
+static inline int hal_analog_read(const struct hal_analog *a, unsigned short *raw)
+{
+	int i;
+
+	for (i = 0; i < HAL_ANALOG_CHANNELS; i++) {
+		raw[i] = hal_host.analog[i];
+	}
+	return a->running;
+}
+
+static inline unsigned short hal_tick_count(void)
+{
+	return hal_host.tick_count;
+}
+
+static inline int hal_tick_pending(void)
+{
+	return 0;
+}
+
+static inline unsigned short hal_hires_count(void)
+{
+	return hal_host.hires_count;
+}
+
+static inline int hal_hires_pending(void)
+{
+	return 0;
+}
+
+/* No interrupts on the plain host backend, unless wait_fn plays them */
+static inline void hal_wait_interrupt(void)
+{
+	if (hal_host.wait_fn) {
+		hal_host.wait_fn(hal_host.wait_ctx);
+	}
+}
+
+static inline void hal_disable_interrupts(void)
+{
+}
+
+static inline void hal_enable_interrupts(void)
+{
+}
+
+#endif /* HAL_HOST_H */
@@ -0,0 +1,472 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   hal_rx62t.h                                */
+/*  File Contents:          Hardware abstraction layer, RX62T backend  */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Register accesses of the RMC-RX62T board, Sensor board Ver. 5 and
+* Motor drive board Ver. 5. Only included through hal.h.
+**/
+
+#ifndef HAL_RX62T_H
+#define HAL_RX62T_H
+
+#include <machine.h>
+#include "iodefine.h"
+
+#define HAL_TICK_COUNTS		97		// CMT0 counts per interrupt (CMCOR + 1), about 1ms
+#define HAL_TICK_COUNT_NS	10417	// one CMT0 count, PCLK/512
+#define HAL_HIRES_HZ		6144000UL	// CMT2 free running, PCLK/8
+#define HAL_SAMPLE_COUNTS	614		// CMT1 counts per sample interrupt, PCLK/8
+#define HAL_SAMPLE_HZ		10000	// about, 6.144MHz / 614
+#define HAL_SERVO_HZ		1536000UL	// MTU3 servo PWM count, ICLK/64
+#define HAL_ANALOG_CHANNELS	8		// line sensors on AN000-AN003, AN100-AN103
+#define HAL_ANALOG_MAX		4095	// 12 bit, 0: brightest (line)
+#define HAL_ANALOG_FRAMES	16		// DTC ring per S12AD unit, in scans
+#define HAL_ANALOG_VECTORS	104		// DTC vector table up to S12ADI1
+
+/* DTC transfer information, full-address mode, big endian (-endian=big).
+ * The DTC writes SAR, DAR and CRB back after every block, hence volatile
+ * members: the control loop must not keep them in registers. */
+struct hal_dtc_info {
+	unsigned char mra;					// MD, SZ, SM
+	unsigned char mrb;					// CHNE, CHNS, DISEL, DTS, DM
+	unsigned short reserved;
+	volatile void *volatile sar;
+	volatile void *volatile dar;
+	unsigned short cra;					// block mode: block size, high and low byte
+	volatile unsigned short crb;		// block mode: blocks left
+};
+
+/* Analog line sensor acquisition, storage provided by the control code.
+ * DTCVBR ignores the low 12 bits: the structure has to start on a 4 KB
+ * boundary (kit12_rx62t.c links it first into RAM at 01000h). */
+struct hal_analog {
+	volatile void *dtc_vector[HAL_ANALOG_VECTORS];
+	struct hal_dtc_info info[2];		// S12AD0, S12AD1
+	volatile unsigned short ring[2][HAL_ANALOG_FRAMES][4];	// ADDR0A-ADDR3 per scan
+};
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		RX62T Initialization                                           */
+/* Arguments:                                                          */
+/*		pwm_cycle:    MTU3 servo PWM frame in counts, HAL_SERVO_HZ     */
+/*		servo_center: servo PWM count for straight ahead               */
+/*		motor_cycle:  GPT1/GPT2 motor PWM period in counts             */
+/***********************************************************************/
+static inline void hal_init(unsigned short pwm_cycle, unsigned short servo_center,
+							unsigned short motor_cycle)
+{
+	/* System Clock */
+	SYSTEM.SCKCR.BIT.ICK = 0;               //12.288*8=98.304MHz
+	SYSTEM.SCKCR.BIT.PCK = 1;               //12.288*4=49.152MHz
+
+	/* Port I/O Settings */
+	PORT1.DDR.BYTE = 0x03;                  //P10:LED2 in motor drive board
+	PORT2.DR.BYTE = 0x08;
+	PORT2.DDR.BYTE = 0x1b;                  //P24:SDCARD_CLK(o)
+											//P23:SDCARD_DI(o)
+											//P22:SDCARD_DO(i)
+											//CN:P21-P20
+	PORT3.DDR.BYTE = 0x00;                  //P33:MTCLKA-A left encoder A(i)
+											//P32:MTCLKB-A left encoder B(i)
+											//P31:MTCLKC-A right encoder A(i)
+											//P30:MTCLKD-A right encoder B(i)
+											//    (was SDCARD_CS, no SD card)
+	PORT3.ICR.BYTE = 0x0f;                  //P33-P30 input buffers on
+	IOPORT.PFCMTU.BIT.TCLKS = 0;            //MTCLKA-D on P33-P30 (-A pins)
+	//PORT4:input                           //sensor input
+	//PORT5:input
+	//PORT6:input
+	PORT7.DDR.BYTE = 0x7e;                  //P76:LED3 in motor drive board
+											//P75:forward reverse signal(right motor)
+											//P74:forward reverse signal(left motor)
+											//P73:PWM(right motor) GTIOC2A
+											//P72:PWM(left motor) GTIOC1A
+											//P71:PWM(servo motor)
+											//P70:Push-button in motor drive board
+	PORT8.DDR.BYTE = 0x07;                  //CN:P82-P80
+	PORT9.DDR.BYTE = 0x7f;                  //CN:P96-P90
+	PORTA.DR.BYTE = 0x0f;                  //CN:PA5-PA4
+											//PA3:LED3(o)
+											//PA2:LED2(o)
+											//PA1:LED1(o)
+											//PA0:LED0(o)
+	PORTA.DDR.BYTE = 0x3f;                  //CN:PA5-PA0
+	PORTB.DDR.BYTE = 0xff;                  //CN:PB7-PB0
+	PORTD.DDR.BYTE = 0x0f;                  //PD7:TRST#(i)
+											//PD5:TDI(i)
+											//PD4:TCK(i)
+											//PD3:TDO(o)
+											//CN:PD2-PD0
+	PORTE.DDR.BYTE = 0x1b;                  //PE5:SW(i)
+											//CN:PE4-PE0
+
+	/* Compare match timer */
+	MSTP_CMT0 = 0;                          //CMT Release module stop state
+	MSTP_CMT2 = 0;                          //CMT Release module stop state
+
+	ICU.IPR[0x04].BYTE = 0x0f;             //CMT0_CMI0 Priority of interrupts
+	ICU.IER[0x03].BIT.IEN4 = 1;             //CMT0_CMI0 Permission for interrupt
+	ICU.IPR[0x05].BYTE = 0x0d;             //CMT1_CMI1 Priority of interrupts
+	ICU.IER[0x03].BIT.IEN5 = 1;             //CMT1_CMI1 Permission for interrupt
+	CMT.CMSTR0.WORD = 0x0000;				//CMT0,CMT1 Stop counting
+	CMT0.CMCR.WORD = 0x00C3;				//PCLK/512
+	CMT0.CMCNT = 0;
+	CMT0.CMCOR = HAL_TICK_COUNTS - 1;		//1ms/(1/(49.152MHz/512))
+	CMT1.CMCR.WORD = 0x00C0;				//PCLK/8
+	CMT1.CMCNT = 0;
+	CMT1.CMCOR = HAL_SAMPLE_COUNTS - 1;		//100us sensor edge sampling
+	CMT.CMSTR0.WORD = 0x0003;				//CMT0,CMT1 Start counting
+
+	/* CMT2 free running over 0000h-FFFFh, CMI2 counts the wraps */
+	ICU.IPR[0x06].BYTE = 0x0e;             //CMT2_CMI2 Priority of interrupts
+	ICU.IER[0x03].BIT.IEN6 = 1;             //CMT2_CMI2 Permission for interrupt
+	CMT.CMSTR1.WORD = 0x0000;				//CMT2,CMT3 Stop counting
+	CMT2.CMCR.WORD = 0x00C0;				//PCLK/8
+	CMT2.CMCNT = 0;
+	CMT2.CMCOR = 0xffff;					//10.67ms per wrap
+	CMT.CMSTR1.WORD = 0x0001;				//CMT2 Start counting
+
+	/* MTU3_3 MTU3_4 PWM mode synchronized by RESET, servo only (MTIOC3B) */
+	MSTP_MTU = 0;							//Release module stop state
+	MTU.TSTRA.BYTE = 0x00;					//MTU Stop counting
+
+	MTU3.TCR.BYTE = 0x23;					//ILCK/64(651.04ns)
+	MTU3.TCNT = MTU4.TCNT = 0;              //MTU3,MTU4TCNT clear
+	MTU3.TGRA = MTU3.TGRC = pwm_cycle;      //servo frame (3ms digital, 16ms analog)
+	MTU3.TGRB = MTU3.TGRD = servo_center;   //PWM(servo motor)
+	MTU4.TGRA = MTU4.TGRC = 0;              //unused, motors are on GPT1/GPT2
+	MTU4.TGRB = MTU4.TGRD = 0;
+	MTU.TOCR1A.BYTE = 0x40;                 //Selection of output level
+	MTU3.TMDR1.BYTE = 0x38;                 //TGRC,TGRD buffer function
+											//PWM mode synchronized by RESET
+	MTU4.TMDR1.BYTE = 0x00;                 //Set 0 to exclude MTU3 effects
+	MTU.TOERA.BYTE = 0xc1;                 //MTU3TGRB permission for output only
+
+	/* GPT1 GPT2 saw-wave PWM, motors: the servo frame does not hold them back */
+	MSTP_GPT = 0;							//Release module stop state
+	GPT.GTSTR.WORD = 0x0000;				//GPT Stop counting
+	GPT1.GTCR.WORD = GPT2.GTCR.WORD = 0x0300;	//saw-wave PWM, ICLK/8(81.38ns)
+	GPT1.GTUDC.WORD = GPT2.GTUDC.WORD = 0x0003;	//count up (forced while stopped)
+	GPT1.GTUDC.WORD = GPT2.GTUDC.WORD = 0x0001;
+	GPT1.GTPR = GPT2.GTPR = motor_cycle;	//cycle
+	GPT1.GTCNT = GPT2.GTCNT = 0;
+	GPT1.GTCCRA = GPT1.GTCCRC = 0;			//PWM(left motor)
+	GPT2.GTCCRA = GPT2.GTCCRC = 0;			//PWM(right motor)
+	GPT1.GTBER.WORD = GPT2.GTBER.WORD = 0x0001;	//GTCCRC buffers GTCCRA, cycle end transfer
+	GPT1.GTIOR.WORD = GPT2.GTIOR.WORD = 0x0009;	//GTIOCnA high at cycle end, low at GTCCRA
+	GPT1.GTONCR.BIT.OAE = 1;				//GTIOC1A permission for output
+	GPT1.GTINTAD.BIT.GTINTPR = 1;			//GTCIV1 at cycle end (overflow)
+	ICU.IPR[0x6B].BYTE = 0x0b;				//GPT1_GTCIV1 Priority of interrupts
+	ICU.IER[0x17].BIT.IEN0 = 1;				//GPT1_GTCIV1 Permission for interrupt
+	GPT2.GTONCR.BIT.OAE = 1;				//GTIOC2A permission for output
+	GPT.GTSTR.WORD = 0x0006;				//GPT1,GPT2 Start counting
+
+	/* MTU1 MTU2 phase counting mode 1, wheel encoders (pins: PORT3 above) */
+	MTU1.TMDR1.BYTE = 0x04;                 //MTCLKA,MTCLKB: left encoder A/B
+	MTU2.TMDR1.BYTE = 0x04;                 //MTCLKC,MTCLKD: right encoder A/B
+	MTU1.TCNT = MTU2.TCNT = 0;              //MTU1,MTU2TCNT clear
+	MTU.TSTRA.BYTE = 0x46;                 //MTU1,MTU2,MTU3 count function
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Line sensors (PORT4, active low)                               */
+/* Return values:                                                      */
+/*		bit 7: leftmost sensor .. bit 0: rightmost, 1: line detected   */
+/***********************************************************************/
+static inline unsigned char hal_sensor_read(void)
+{
+	return (unsigned char)~PORT4.PORT.BYTE;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Start bar detection sensor                                     */
+/* Return values:                                                      */
+/*		ON (bar present):1, OFF (no bar present):0                     */
+/***********************************************************************/
+static inline unsigned char hal_startbar_read(void)
+{
+	return ~PORT4.PORT.BIT.B0 & 0x01;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		DIP switch (P63~P60)                                           */
+/* Return values:                                                      */
+/*		Switch value, 0 to 15                                          */
+/***********************************************************************/
+static inline unsigned char hal_dipsw_read(void)
+{
+	unsigned char d0, d1, d2, d3;
+	d0 = (PORT6.PORT.BIT.B3 & 0x01);
+	d1 = (PORT6.PORT.BIT.B2 & 0x01) << 1;
+	d2 = (PORT6.PORT.BIT.B1 & 0x01) << 2;
+	d3 = (PORT6.PORT.BIT.B0 & 0x01) << 3;
+
+	return d0 | d1 | d2 | d3;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Push-button in MCU board (PE5)                                 */
+/* Return values:                                                      */
+/*		Switch value, ON: 1, OFF: 0                                    */
+/***********************************************************************/
+static inline unsigned char hal_buttonsw_read(void)
+{
+	return ~PORTE.PORT.BIT.B5 & 0x01;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Push-button in motor drive board (P70)                         */
+/* Return values:                                                      */
+/*		Switch value, ON: 1, OFF: 0                                    */
+/***********************************************************************/
+static inline unsigned char hal_pushsw_read(void)
+{
+	return ~PORT7.PORT.BIT.B0 & 0x01;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		LEDs in MCU board (PA3~PA0, active low)                        */
+/* Arguments:                                                          */
+/*		LED0: bit 0, LED1: bit 1. 0: dark, 1: lit                      */
+/***********************************************************************/
+static inline void hal_led_m_write(unsigned char led)
+{
+	led = ~led;
+	PORTA.DR.BYTE = led & 0x0f;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		LEDs in motor drive board (P76, P10, active low)               */
+/* Arguments:                                                          */
+/*		LED0: bit 0, LED1: bit 1. 0: dark, 1: lit                      */
+/***********************************************************************/
+static inline void hal_led_write(unsigned char led)
+{
+	led = ~led;
+	PORT7.DR.BIT.B6 = led & 0x01;
+	PORT1.DR.BIT.B0 = (led >> 1) & 0x01;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Motor PWM (GPT1.GTCCRC left, GPT2.GTCCRC right), buffered:     */
+/*		the counts take effect at the next cycle end                   */
+/* Arguments:                                                          */
+/*		left, right: PWM count                                         */
+/***********************************************************************/
+static inline void hal_motor_duty(unsigned short left, unsigned short right)
+{
+	GPT1.GTCCRC = left;
+	GPT2.GTCCRC = right;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Motor forward reverse signals (P74 left, P75 right), both in   */
+/*		one write                                                      */
+/* Arguments:                                                          */
+/*		reverse: bit 0 left, bit 1 right, 1: reverse                   */
+/***********************************************************************/
+static inline void hal_motor_dir(unsigned char reverse)
+{
+	PORT7.DR.BYTE = (unsigned char)((PORT7.DR.BYTE & 0xcf) | (reverse & 0x03) << 4);
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Servo PWM (MTU3.TGRD)                                          */
+/* Arguments:                                                          */
+/*		count: PWM count                                               */
+/***********************************************************************/
+static inline void hal_servo_write(unsigned short count)
+{
+	MTU3.TGRD = count;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Wheel encoders (MTU1, MTU2 phase counting)                     */
+/* Return values:                                                      */
+/*		count, every edge of both phases, wraps after 0xffff           */
+/***********************************************************************/
+static inline unsigned short hal_encoder_left(void)
+{
+	return MTU1.TCNT;
+}
+
+static inline unsigned short hal_encoder_right(void)
+{
+	return MTU2.TCNT;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Analog line sensor acquisition                                 */
+/*		S12AD0 (P40-P43) and S12AD1 (P44-P47) scan their 4 channels    */
+/*		continuously at PCLK/8, about 30 kHz. Every scan end (S12ADI0, */
+/*		S12ADI1) starts a DTC block transfer of ADDR0A-ADDR3 into the  */
+/*		next ring slot, without the CPU. Only after HAL_ANALOG_FRAMES  */
+/*		scans the DTC hands the request to the CPU, whose interrupt    */
+/*		handler calls hal_analog_rearm()                               */
+/* Arguments:                                                          */
+/*		a: storage, see struct hal_analog                              */
+/***********************************************************************/
+static inline void hal_analog_rearm(struct hal_analog *a, int unit)
+{
+	a->info[unit].dar = a->ring[unit][0];
+	a->info[unit].crb = HAL_ANALOG_FRAMES;
+	ICU.DTCER[102 + unit].BIT.DTCE = 1;		//S12ADI0, S12ADI1 start the DTC again
+}
+
+static inline void hal_analog_init(struct hal_analog *a)
+{
+	int unit, i;
+
+	MSTP_DTC = 0;							//Release module stop state
+	MSTP_S12AD0 = 0;
+	MSTP_S12AD1 = 0;
+
+	for (unit = 0; unit < 2; unit++) {
+		for (i = 0; i < HAL_ANALOG_FRAMES * 4; i++) {
+			a->ring[unit][i / 4][i % 4] = 0xffff;	//not converted yet
+		}
+		a->info[unit].mra = 0x98;				//block transfer, word, SAR incremented
+		a->info[unit].mrb = 0x18;				//source is the block area, DAR incremented
+		a->info[unit].cra = 0x0404;				//4 words per block
+		a->dtc_vector[102 + unit] = &a->info[unit];
+	}
+	a->info[0].sar = &S12AD0.ADDR0A;
+	a->info[1].sar = &S12AD1.ADDR0A;
+	hal_analog_rearm(a, 0);
+	hal_analog_rearm(a, 1);
+
+	DTC.DTCVBR = (void *)a->dtc_vector;
+	DTC.DTCADMOD.BIT.SHORT = 0;				//full-address mode
+	DTC.DTCCR.BIT.RRS = 0;					//always read the transfer information
+	DTC.DTCST.BIT.DTCST = 1;				//DTC Start
+
+	ICU.IPR[0x48].BYTE = 0x0c;				//S12ADI0, S12ADI1 Priority of interrupts
+	ICU.IER[0x0C].BIT.IEN6 = 1;				//S12ADI0 Permission for interrupt (and DTC)
+	ICU.IER[0x0C].BIT.IEN7 = 1;				//S12ADI1 Permission for interrupt (and DTC)
+
+	S12AD0.ADANS.BIT.CH = 3;				//AN000-AN003
+	S12AD1.ADANS.BIT.CH = 3;				//AN100-AN103
+	S12AD0.ADCSR.BYTE = 0x50;				//continuous scan, S12ADI0, PCLK/8
+	S12AD1.ADCSR.BYTE = 0x50;				//continuous scan, S12ADI1, PCLK/8
+	S12AD0.ADCSR.BIT.ADST = 1;				//Start scanning
+	S12AD1.ADCSR.BIT.ADST = 1;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Latest complete scan of both units                             */
+/*		The DTC fills the slot after it meanwhile, a slot is only      */
+/*		rewritten HAL_ANALOG_FRAMES scans (0.5 ms) later               */
+/* Arguments:                                                          */
+/*		raw: HAL_ANALOG_CHANNELS results, bit order of                 */
+/*		     hal_sensor_read() (0: P40 .. 7: P47)                      */
+/* Return values:                                                      */
+/*		1: raw filled, 0: no scan complete yet or the ADC stopped      */
+/***********************************************************************/
+static inline int hal_analog_read(const struct hal_analog *a, unsigned short *raw)
+{
+	const volatile unsigned short *slot;
+	int unit, i, done;
+
+	if (!S12AD0.ADCSR.BIT.ADST || !S12AD1.ADCSR.BIT.ADST) {
+		return 0;
+	}
+	for (unit = 0; unit < 2; unit++) {
+		/* DAR points behind the last transferred block */
+		done = (int)((const volatile unsigned short *)a->info[unit].dar - a->ring[unit][0]) / 4;
+		slot = a->ring[unit][(done + HAL_ANALOG_FRAMES - 1) % HAL_ANALOG_FRAMES];
+		for (i = 0; i < 4; i++) {
+			if (slot[i] == 0xffff) {
+				return 0;
+			}
+			raw[unit * 4 + i] = slot[i];
+		}
+	}
+	return 1;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Time since the last CMT0 interrupt                             */
+/* Return values:                                                      */
+/*		0 to HAL_TICK_COUNTS - 1, HAL_TICK_COUNT_NS each               */
+/***********************************************************************/
+static inline unsigned short hal_tick_count(void)
+{
+	unsigned short cnt = CMT0.CMCNT;
+
+	/* The compare match (and CMI0) happens while CMCNT == CMCOR */
+	return (cnt == HAL_TICK_COUNTS - 1) ? 0 : cnt + 1;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		CMT0 compare match raised but not yet serviced                 */
+/* Return values:                                                      */
+/*		1: hal_tick_count() has wrapped, the interrupt is still due    */
+/***********************************************************************/
+static inline int hal_tick_pending(void)
+{
+	return ICU.IR[28].BIT.IR;				//CMT0_CMI0
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Free running high resolution counter                           */
+/* Return values:                                                      */
+/*		CMT2 count, HAL_HIRES_HZ, wraps after 0xffff                   */
+/***********************************************************************/
+static inline unsigned short hal_hires_count(void)
+{
+	return CMT2.CMCNT;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		CMT2 wrap raised but not yet serviced                          */
+/***********************************************************************/
+static inline int hal_hires_pending(void)
+{
+	return ICU.IR[30].BIT.IR;				//CMT2_CMI2
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Sleep until the next interrupt (WAIT instruction)              */
+/***********************************************************************/
+static inline void hal_wait_interrupt(void)
+{
+	wait();
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Mask and unmask all interrupts (PSW.I)                         */
+/***********************************************************************/
+static inline void hal_disable_interrupts(void)
+{
+	clrpsw_i();
+}
+
+static inline void hal_enable_interrupts(void)
+{
+	setpsw_i();
+}
+
+#endif /* HAL_RX62T_H */
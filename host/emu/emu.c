@@ -0,0 +1,975 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   emu/emu.c                                  */
+/*  File Contents:          RX62T peripheral emulator                  */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+
+#include <setjmp.h>
+#include <string.h>
+
+#include "iodefine.h"
+
+/*======================================*/
+/* Symbol definitions                   */
+/*======================================*/
+#define EMU_DEFAULT_ACCESS_CYCLES	16	// ~0.33us of firmware per access
+#define EMU_NO_DEV					EMU_DEV_COUNT
+#define EMU_NEVER					(~(emu_time_t)0)
+#define EMU_ADC_STATES				50	// ADCLK states per 12 bit conversion
+#define EMU_ADC_UNITS				2
+
+/* Firmware interrupt handlers, resolved at link time if present */
+extern void Excep_CMT0_CMI0(void) __attribute__((weak));
+extern void Excep_CMT1_CMI1(void) __attribute__((weak));
+extern void Excep_CMT2_CMI2(void) __attribute__((weak));
+extern void Excep_CMT3_CMI3(void) __attribute__((weak));
+extern void Excep_S12AD0_S12ADI0(void) __attribute__((weak));
+extern void Excep_S12AD1_S12ADI1(void) __attribute__((weak));
+extern void Excep_GPT1_GTCIV1(void) __attribute__((weak));
+extern void Excep_GPT2_GTCIV2(void) __attribute__((weak));
+
+/* Interrupt sources: vector, IER index and bit, IPR index, handler */
+struct emu_irq {
+	unsigned char vect;
+	unsigned char ier;
+	unsigned char ien;
+	unsigned char ipr;
+	void (*isr)(void);
+};
+
+enum emu_irq_id {
+	EMU_IRQ_CMI0,
+	EMU_IRQ_CMI1,
+	EMU_IRQ_CMI2,
+	EMU_IRQ_CMI3,
+	EMU_IRQ_S12ADI0,
+	EMU_IRQ_S12ADI1,
+	EMU_IRQ_GTCIV1,
+	EMU_IRQ_GTCIV2,
+	EMU_IRQ_COUNT
+};
+
+/* One CMT channel as seen from the emulated clock */
+struct emu_cmt {
+	int running;
+	emu_time_t base;			// time CMCNT had the value base_cnt
+	unsigned short base_cnt;
+	unsigned short placed;		// CMCNT value last presented to the firmware
+	unsigned short cmcor;
+	unsigned char cks;
+	emu_time_t next;			// next compare match
+};
+
+/* One encoder channel: TCNT follows encoder_fn() while counting */
+struct emu_enc {
+	int running;
+	long offset;				// TCNT - encoder_fn()
+	unsigned short placed;		// TCNT value last presented to the firmware
+};
+
+/* One GPT channel, saw-wave counting up: a cycle ends every period.
+   Only scheduled while its cycle end raises GTCIV, see emu_schedule() */
+struct emu_gpt {
+	int running;
+	emu_time_t period;
+	emu_time_t next;			// next cycle end (overflow)
+};
+
+/* One S12AD unit: a scan ends every period while running. Scans are
+   converted when someone can see them, see emu_adc_catch_up() */
+struct emu_adc {
+	int running;
+	emu_time_t period;
+	emu_time_t next;			// next scan end not converted yet
+	emu_time_t due;				// scan end that requests the CPU, EMU_NEVER: none
+};
+
+struct emu_state {
+	struct emu_config cfg;
+	struct emu_stats stats;
+
+	emu_time_t now;
+	emu_time_t last_access;
+	emu_time_t next_event;
+	emu_time_t next_step;
+	emu_time_t stop_at;
+
+	jmp_buf stop;
+	enum emu_stop stop_reason;
+	int running;
+	int in_isr;
+	int irq_enabled;			// PSW.I
+	int irq_raised;				// some IR flag may be set
+	enum emu_dev pending;		// last accessed block, not yet committed
+
+	struct emu_irq irq[EMU_IRQ_COUNT];
+	struct emu_cmt cmt_ch[4];
+	struct emu_enc enc[EMU_ENCODER_COUNT];
+	struct emu_adc adc[EMU_ADC_UNITS];
+	unsigned char adc_route[3];	// ICU bytes that route S12ADI, before the access
+	struct emu_gpt gpt_ch[2];	// GPT1, GPT2
+	unsigned short out[EMU_ACTUATOR_COUNT];
+
+	/* Register blocks */
+	struct st_system system;
+	struct st_icu icu;
+	struct st_cmt cmt;
+	struct st_cmt0 cmt0[4];
+	struct st_dtc dtc;
+	struct st_gpt gpt;
+	struct st_gpt0 gpt0[2];			// GPT1, GPT2
+	struct st_s12ad0 s12ad[EMU_ADC_UNITS];
+	struct st_mtu mtu;
+	struct st_mtu1 mtu1[EMU_ENCODER_COUNT];
+	struct st_mtu3 mtu3;
+	struct st_mtu3 mtu4;
+	struct st_ioport ioport;
+	struct st_port port[EMU_PORTE - EMU_PORT1 + 1];
+	void *dev[EMU_DEV_COUNT];
+};
+
+/* One emulated MCU per thread, see HAL_STATE in hal.h */
+static _Thread_local struct emu_state emu;
+
+static const unsigned int cmt_divisor[4] = { 8, 32, 128, 512 };
+static const unsigned int adc_divisor[4] = { 8, 4, 2, 1 };
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Time bookkeeping                                               */
+/***********************************************************************/
+static void emu_schedule(void)
+{
+	int i;
+	emu_time_t next = emu.stop_at;
+
+	if (emu.cfg.step_fn && emu.next_step < next) {
+		next = emu.next_step;
+	}
+	for (i = 0; i < 4; i++) {
+		if (emu.cmt_ch[i].running && emu.cmt_ch[i].next < next) {
+			next = emu.cmt_ch[i].next;
+		}
+	}
+	for (i = 0; i < EMU_ADC_UNITS; i++) {
+		if (emu.adc[i].running && emu.adc[i].due < next) {
+			next = emu.adc[i].due;
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		if (emu.gpt_ch[i].running && (emu.gpt0[i].GTINTAD.BIT.GTINTPR & 1) && emu.gpt_ch[i].next < next) {
+			next = emu.gpt_ch[i].next;
+		}
+	}
+	emu.next_event = next;
+}
+
+/* First of the times next + k * period that is later than t */
+static emu_time_t emu_after(emu_time_t next, emu_time_t period, emu_time_t t)
+{
+	return (next > t) ? next : next + ((t - next) / period + 1) * period;
+}
+
+static unsigned short emu_cmt_count(const struct emu_cmt *c, emu_time_t t)
+{
+	emu_time_t ticks;
+
+	if (!c->running) {
+		return c->base_cnt;
+	}
+	ticks = (t - c->base) / cmt_divisor[c->cks];
+	return (unsigned short)((c->base_cnt + ticks) % ((emu_time_t)c->cmcor + 1));
+}
+
+/* Re-evaluate a CMT channel after the firmware touched its registers */
+static void emu_cmt_update(int ch)
+{
+	struct emu_cmt *c = &emu.cmt_ch[ch];
+	struct st_cmt0 *r = &emu.cmt0[ch];
+	int running;
+	int stopped;
+	unsigned short cnt;
+
+	stopped = (ch < 2) ? emu.system.MSTPCRA.BIT.MSTPA15 : emu.system.MSTPCRA.BIT.MSTPA14;
+	running = !stopped && ((ch < 2 ? emu.cmt.CMSTR0.WORD : emu.cmt.CMSTR1.WORD) >> (ch & 1) & 1);
+
+	if (r->CMCNT == c->placed && running == c->running &&
+		r->CMCOR == c->cmcor && r->CMCR.BIT.CKS == c->cks) {
+		return;
+	}
+
+	/* CMCNT written by the firmware, else keep counting from here */
+	cnt = (r->CMCNT != c->placed) ? r->CMCNT : emu_cmt_count(c, emu.last_access);
+	if (cnt > r->CMCOR) {
+		cnt = 0;
+	}
+
+	c->running = running;
+	c->base = emu.last_access;
+	c->base_cnt = cnt;
+	c->placed = cnt;
+	c->cmcor = r->CMCOR;
+	c->cks = r->CMCR.BIT.CKS;
+	c->next = c->base + (emu_time_t)(c->cmcor - cnt) * cmt_divisor[c->cks];
+	if (c->next <= emu.now) {
+		c->next += ((emu_time_t)c->cmcor + 1) * cmt_divisor[c->cks];
+	}
+	r->CMCNT = cnt;
+
+	emu_schedule();
+}
+
+/* Encoder input edges since reset */
+static long emu_enc_edges(int ch)
+{
+	return emu.cfg.encoder_fn ? emu.cfg.encoder_fn(emu.cfg.ctx, (enum emu_encoder)ch, emu.last_access) : 0;
+}
+
+static unsigned short emu_enc_count(int ch)
+{
+	struct emu_enc *e = &emu.enc[ch];
+
+	return e->running ? (unsigned short)(e->offset + emu_enc_edges(ch)) : e->placed;
+}
+
+/* MTCLKA/B (MTU1) and MTCLKC/D (MTU2) reach the MTU: TCLKS 0 selects
+   P33-P30, each an input (DDR 0) with its input buffer on (ICR 1) */
+int emu_encoder_pins(enum emu_encoder encoder)
+{
+	const struct st_port *p3 = &emu.port[EMU_PORT3 - EMU_PORT1];
+	unsigned char pins = (encoder == EMU_ENCODER_LEFT) ? 0x0c : 0x03;
+
+	return emu.ioport.PFCMTU.BIT.TCLKS == 0 && !(p3->DDR.BYTE & pins) && (p3->ICR.BYTE & pins) == pins;
+}
+
+/* Re-evaluate an encoder channel after the firmware touched MTU1/MTU2,
+   PORT3 or IOPORT */
+static void emu_enc_update(int ch)
+{
+	struct emu_enc *e = &emu.enc[ch];
+	struct st_mtu1 *r = &emu.mtu1[ch];
+	unsigned short cnt;
+
+	/* TCNT written by the firmware, else keep counting from here */
+	cnt = (r->TCNT != e->placed) ? r->TCNT : emu_enc_count(ch);
+
+	/* Phase counting modes 1 to 4 only, other modes do not count */
+	e->running = !emu.system.MSTPCRA.BIT.MSTPA9 && (emu.mtu.TSTRA.BYTE >> (ch + 1) & 1) &&
+				 r->TMDR1.BIT.MD >= 4 && r->TMDR1.BIT.MD <= 7 && emu_encoder_pins((enum emu_encoder)ch);
+	e->offset = (long)cnt - emu_enc_edges(ch);
+	e->placed = cnt;
+	r->TCNT = cnt;
+}
+
+/* Re-evaluate GPT1/GPT2 after the firmware touched their registers.
+ * The count clock is ICLK (2 PCLK) / 1, 2, 4, 8; a channel started
+ * with GTCNT 0 ends its first cycle one period later. */
+static void emu_gpt_update(int ch)
+{
+	struct emu_gpt *g = &emu.gpt_ch[ch];
+	struct st_gpt0 *r = &emu.gpt0[ch];
+	int running;
+
+	running = !emu.system.MSTPCRA.BIT.MSTPA7 && (emu.gpt.GTSTR.WORD >> (ch + 1) & 1);
+	g->period = (((emu_time_t)r->GTPR + 1) << r->GTCR.BIT.TPCS) / 2;
+	if (g->period == 0) {
+		g->period = 1;
+	}
+	if (running && !g->running) {
+		g->next = emu.last_access + g->period - ((emu_time_t)r->GTCNT << r->GTCR.BIT.TPCS) / 2;
+	}
+	else if (running) {
+		g->next = emu_after(g->next, g->period, emu.last_access);	// GTCIV may just be enabled
+	}
+	g->running = running;
+	emu_schedule();
+}
+
+static void emu_raise(enum emu_irq_id id)
+{
+	emu.icu.IR[emu.irq[id].vect].BIT.IR = 1;
+	emu.irq_raised = 1;
+}
+
+/* The DTC takes the request of this source instead of the CPU */
+static int emu_dtc_selected(const struct emu_irq *q)
+{
+	return emu.icu.DTCER[q->vect].BIT.DTCE && emu.dtc.DTCST.BIT.DTCST &&
+		   !emu.system.MSTPCRA.BIT.MSTPA28 && ((emu.icu.IER[q->ier].BYTE >> q->ien) & 1);
+}
+
+/* Transfer information of a DTC vector */
+static struct emu_dtc_info *emu_dtc_info(unsigned char vect)
+{
+	return ((struct emu_dtc_info **)emu.dtc.DTCVBR)[vect];
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		DTC activations by up to n requests of the same source         */
+/*		Stops after the activation that passes the request on to the  */
+/*		CPU (DISEL or transfer end)                                    */
+/* Return values:                                                      */
+/*		activations done, *pass: the last one passes the request on    */
+/***********************************************************************/
+static emu_time_t emu_dtc_transfer(unsigned char vect, emu_time_t n, int *pass)
+{
+	struct emu_dtc_info *d = emu_dtc_info(vect);
+	unsigned int size = 1u << ((d->mra >> 4) & 3);
+	unsigned int mode = d->mra >> 6;
+	unsigned int units = (mode == 2) ? ((d->cra >> 8) ? (d->cra >> 8) : 256) : 1;
+	long sstep = ((d->mra >> 2) & 3) == 2 ? (long)size : ((d->mra >> 2) & 3) == 3 ? -(long)size : 0;
+	long dstep = ((d->mrb >> 2) & 3) == 2 ? (long)size : ((d->mrb >> 2) & 3) == 3 ? -(long)size : 0;
+	int dts = (d->mrb >> 4) & 1;
+	int disel = (d->mrb >> 5) & 1;
+	volatile char *src = (volatile char *)d->sar;
+	volatile char *dst = (volatile char *)d->dar;
+	volatile char *block;
+	unsigned int i, left;
+	emu_time_t done = 0;
+	int end = 0;
+
+	while (done < n && !end) {
+		done++;
+		block = dts ? src : dst;
+		for (i = 0; i < units; i++) {
+			switch (size) {		// one move per unit, the firmware is not running
+			case 1: memcpy((char *)dst, (const char *)src, 1); break;
+			case 2: memcpy((char *)dst, (const char *)src, 2); break;
+			default: memcpy((char *)dst, (const char *)src, 4); break;
+			}
+			src += sstep;
+			dst += dstep;
+		}
+
+		switch (mode) {
+		case 0:		// normal: CRA counts units
+			end = (--d->cra == 0);
+			break;
+
+		case 1:		// repeat: CRAL counts down from CRAH, then the repeat area starts over
+			left = ((d->cra & 0xff) ? (d->cra & 0xff) : 256) - 1;
+			if (left == 0) {
+				left = (d->cra >> 8) ? (d->cra >> 8) : 256;
+				if (dts) {
+					src -= sstep * (long)left;
+				}
+				else {
+					dst -= dstep * (long)left;
+				}
+			}
+			d->cra = (unsigned short)((d->cra & 0xff00) | (left & 0xff));
+			break;
+
+		default:	// block: the block area starts over, CRB counts blocks
+			if (dts) {
+				src = block;
+			}
+			else {
+				dst = block;
+			}
+			end = (--d->crb == 0);
+			break;
+		}
+		if (disel) {
+			break;
+		}
+	}
+	d->sar = src;
+	d->dar = dst;
+	emu.stats.dtc_transfers += done;
+
+	if (end) {
+		emu.icu.DTCER[vect].BIT.DTCE = 0;
+	}
+	*pass = end || disel;
+	return done;
+}
+
+/* n interrupt requests of a peripheral: to the DTC while selected, else the CPU */
+static void emu_request(enum emu_irq_id id, emu_time_t n)
+{
+	const struct emu_irq *q = &emu.irq[id];
+	int pass;
+
+	while (n > 0) {
+		if (!emu_dtc_selected(q)) {
+			emu_raise(id);			// one IR flag for any number of requests
+			return;
+		}
+		n -= emu_dtc_transfer(q->vect, n, &pass);
+		if (pass) {
+			emu_raise(id);
+		}
+	}
+}
+
+/* Scans from the next one on until one requests the CPU: every one
+   without the DTC, the last of a DTC transfer (or each with DISEL) */
+static void emu_adc_plan(int unit)
+{
+	struct emu_adc *a = &emu.adc[unit];
+	struct st_s12ad0 *r = &emu.s12ad[unit];
+	const struct emu_irq *q = &emu.irq[EMU_IRQ_S12ADI0 + unit];
+	const struct emu_dtc_info *d;
+	emu_time_t scans = 1;
+
+	a->due = EMU_NEVER;
+	if (!a->running || !r->ADCSR.BIT.ADIE) {
+		return;
+	}
+	if (emu_dtc_selected(q)) {
+		d = emu_dtc_info(q->vect);
+		if (!((d->mrb >> 5) & 1)) {
+			switch (d->mra >> 6) {
+			case 0: scans = d->cra ? d->cra : 0x10000; break;
+			case 1: return;			// repeat: never ends
+			default: scans = d->crb ? d->crb : 0x10000; break;
+			}
+		}
+	}
+	if (r->ADCSR.BIT.ADCS == 0 && scans > 1) {
+		return;						// single scan, into the DTC
+	}
+	a->due = a->next + (scans - 1) * a->period;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Convert the scans that ended by t, all in one go: nothing sees */
+/*		a scan before it requests the CPU or someone accesses the      */
+/*		S12AD, the DTC, the module stop or the ICU routing. Every scan */
+/*		of the batch gets the levels of the last one; analog_fn inputs */
+/*		only change in step_fn, and every step ends a batch.           */
+/***********************************************************************/
+static void emu_adc_catch_up(int unit, emu_time_t t)
+{
+	struct emu_adc *a = &emu.adc[unit];
+	struct st_s12ad0 *r = &emu.s12ad[unit];
+	unsigned short *addr = &r->ADDR0A;
+	emu_time_t n, last;
+	int ch;
+
+	if (!a->running || a->next > t) {
+		return;
+	}
+	n = (r->ADCSR.BIT.ADCS == 0) ? 1 : (t - a->next) / a->period + 1;
+	last = a->next + (n - 1) * a->period;
+	a->next = last + a->period;
+
+	for (ch = 0; ch <= r->ADANS.BIT.CH; ch++) {
+		addr[ch] = emu.cfg.analog_fn ? emu.cfg.analog_fn(emu.cfg.ctx, unit * 4 + ch, last) & 0x0fff : 0x0fff;
+	}
+	if (r->ADCSR.BIT.ADCS == 0) {
+		r->ADCSR.BIT.ADST = 0;		// single scan
+		a->running = 0;
+	}
+	if (r->ADCSR.BIT.ADIE) {
+		emu_request(EMU_IRQ_S12ADI0 + unit, n);
+	}
+	emu_adc_plan(unit);
+}
+
+static void emu_adc_catch_up_all(emu_time_t t)
+{
+	int i;
+
+	for (i = 0; i < EMU_ADC_UNITS; i++) {
+		emu_adc_catch_up(i, t);
+	}
+}
+
+/* Re-evaluate an S12AD unit after the firmware touched its registers,
+   the DTC or the ICU */
+static void emu_adc_update(int unit)
+{
+	struct emu_adc *a = &emu.adc[unit];
+	struct st_s12ad0 *r = &emu.s12ad[unit];
+	int running;
+
+	running = !((emu.system.MSTPCRA.LONG >> (17 - unit)) & 1) && r->ADCSR.BIT.ADST;
+	a->period = (emu_time_t)(r->ADANS.BIT.CH + 1) * EMU_ADC_STATES * adc_divisor[r->ADCSR.BIT.CKS];
+	if (running && !a->running) {
+		a->next = emu.last_access + a->period;
+	}
+	a->running = running;
+	emu_adc_plan(unit);
+	emu_schedule();
+}
+
+/* ICU bytes that decide between DTC and CPU for S12ADI0/S12ADI1 */
+static void emu_adc_route(unsigned char *route)
+{
+	route[0] = emu.icu.DTCER[emu.irq[EMU_IRQ_S12ADI0].vect].BYTE;
+	route[1] = emu.icu.DTCER[emu.irq[EMU_IRQ_S12ADI1].vect].BYTE;
+	route[2] = emu.icu.IER[emu.irq[EMU_IRQ_S12ADI0].ier].BYTE;
+}
+
+/* ICU written: the scans before the access still go the old way */
+static void emu_adc_reroute(void)
+{
+	unsigned char now[3];
+	int i;
+
+	emu_adc_route(now);
+	if (!memcmp(now, emu.adc_route, sizeof(now))) {
+		return;
+	}
+	emu.icu.DTCER[emu.irq[EMU_IRQ_S12ADI0].vect].BYTE = emu.adc_route[0];
+	emu.icu.DTCER[emu.irq[EMU_IRQ_S12ADI1].vect].BYTE = emu.adc_route[1];
+	emu.icu.IER[emu.irq[EMU_IRQ_S12ADI0].ier].BYTE = emu.adc_route[2];
+	emu_adc_catch_up_all(emu.last_access);
+	emu.icu.DTCER[emu.irq[EMU_IRQ_S12ADI0].vect].BYTE = now[0];
+	emu.icu.DTCER[emu.irq[EMU_IRQ_S12ADI1].vect].BYTE = now[1];
+	emu.icu.IER[emu.irq[EMU_IRQ_S12ADI0].ier].BYTE = now[2];
+	for (i = 0; i < EMU_ADC_UNITS; i++) {
+		emu_adc_update(i);
+	}
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Actuator capture                                               */
+/***********************************************************************/
+static void emu_record(enum emu_actuator a, unsigned short value)
+{
+	struct emu_write w;
+
+	if (emu.out[a] == value) {
+		return;
+	}
+	emu.out[a] = value;
+
+	w.time = emu.last_access;
+	w.actuator = (unsigned char)a;
+	w.value = value;
+
+	emu.stats.writes[a]++;
+	if (emu.stats.log_count < emu.cfg.log_size) {
+		emu.cfg.log[emu.stats.log_count++] = w;
+	}
+	if (emu.cfg.write_fn) {
+		emu.cfg.write_fn(emu.cfg.ctx, &w);
+	}
+}
+
+/* Evaluate the writes the firmware made to the last accessed block */
+static void emu_commit(void)
+{
+	enum emu_dev dev = emu.pending;
+	unsigned char led;
+	int i;
+
+	emu.pending = EMU_NO_DEV;
+
+	switch (dev) {
+	case EMU_GPT:
+		for (i = 0; i < 2; i++) {
+			emu_gpt_update(i);
+		}
+		break;
+
+	case EMU_GPT1:
+		emu_record(EMU_MOTOR_LEFT, emu.gpt0[0].GTCCRC);
+		emu_gpt_update(0);
+		break;
+
+	case EMU_GPT2:
+		emu_record(EMU_MOTOR_RIGHT, emu.gpt0[1].GTCCRC);
+		emu_gpt_update(1);
+		break;
+
+	case EMU_MTU3:
+		emu_record(EMU_SERVO, emu.mtu3.TGRD);
+		break;
+
+	case EMU_PORT7:
+		emu_record(EMU_MOTOR_DIR, (emu.port[EMU_PORT7 - EMU_PORT1].DR.BYTE >> 4) & 0x03);
+		/* fall through: LED0 is P76 */
+	case EMU_PORT1:
+		led = (~emu.port[EMU_PORT7 - EMU_PORT1].DR.BIT.B6 & 0x01) |
+			  (~emu.port[EMU_PORT1 - EMU_PORT1].DR.BIT.B0 & 0x01) << 1;
+		emu_record(EMU_LED, led);
+		break;
+
+	case EMU_SYSTEM:
+	case EMU_CMT:
+		for (i = 0; i < 4; i++) {
+			emu_cmt_update(i);
+		}
+		if (dev == EMU_CMT) {
+			break;
+		}
+		for (i = 0; i < EMU_ADC_UNITS; i++) {
+			emu_adc_update(i);
+		}
+		for (i = 0; i < 2; i++) {
+			emu_gpt_update(i);
+		}
+		/* fall through: MSTPCRA also stops the MTU */
+	case EMU_MTU:
+	case EMU_PORT3:
+	case EMU_IOPORT:
+		for (i = 0; i < EMU_ENCODER_COUNT; i++) {
+			emu_enc_update(i);
+		}
+		break;
+
+	case EMU_MTU1:
+	case EMU_MTU2:
+		emu_enc_update(dev - EMU_MTU1);
+		break;
+
+	case EMU_S12AD0:
+	case EMU_S12AD1:
+		emu_adc_update(dev - EMU_S12AD0);
+		break;
+
+	case EMU_CMT0:
+	case EMU_CMT1:
+	case EMU_CMT2:
+	case EMU_CMT3:
+		emu_cmt_update(dev - EMU_CMT0);
+		break;
+
+	case EMU_ICU:
+		emu.irq_raised = 1;		// IER or IPR may unmask a pending request
+		emu_adc_reroute();
+		break;
+
+	case EMU_DTC:
+		for (i = 0; i < EMU_ADC_UNITS; i++) {
+			emu_adc_update(i);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Events and interrupt delivery                                  */
+/***********************************************************************/
+static void emu_events(void)
+{
+	int i;
+
+	while (emu.now >= emu.next_event) {
+		if (emu.now >= emu.stop_at) {
+			longjmp(emu.stop, 1);
+		}
+		for (i = 0; i < 4; i++) {
+			struct emu_cmt *c = &emu.cmt_ch[i];
+			while (c->running && c->next <= emu.now) {
+				if (emu.cmt0[i].CMCR.BIT.CMIE) {
+					emu_raise(EMU_IRQ_CMI0 + i);
+				}
+				c->next += ((emu_time_t)c->cmcor + 1) * cmt_divisor[c->cks];
+			}
+		}
+		for (i = 0; i < EMU_ADC_UNITS; i++) {
+			if (emu.adc[i].running && emu.adc[i].due <= emu.now) {
+				emu_adc_catch_up(i, emu.now);
+			}
+		}
+		/* Cycle ends without GTCIV are not scheduled, only counted on */
+		for (i = 0; i < 2; i++) {
+			struct emu_gpt *g = &emu.gpt_ch[i];
+			if (g->running && g->next <= emu.now) {
+				if (emu.gpt0[i].GTINTAD.BIT.GTINTPR & 1) {
+					emu_raise(EMU_IRQ_GTCIV1 + i);
+				}
+				g->next = emu_after(g->next, g->period, emu.now);
+			}
+		}
+		while (emu.cfg.step_fn && emu.next_step <= emu.now) {
+			emu_adc_catch_up_all(emu.next_step);		// the levels change in the step
+			emu.cfg.step_fn(emu.cfg.ctx, emu.next_step);
+			emu.next_step += emu.cfg.step_cycles;
+			if (emu.now >= emu.stop_at) {
+				longjmp(emu.stop, 1);
+			}
+		}
+		emu_schedule();
+	}
+}
+
+static void emu_deliver(void)
+{
+	int i;
+	int best;
+
+	while (emu.irq_enabled && !emu.in_isr && emu.irq_raised) {
+		best = -1;
+		emu.irq_raised = 0;
+		for (i = 0; i < EMU_IRQ_COUNT; i++) {
+			const struct emu_irq *q = &emu.irq[i];
+			if (!emu.icu.IR[q->vect].BIT.IR) {
+				continue;
+			}
+			emu.irq_raised = 1;
+			if (!((emu.icu.IER[q->ier].BYTE >> q->ien) & 1) || !emu.icu.IPR[q->ipr].BIT.IPR) {
+				continue;
+			}
+			if (best < 0 || emu.icu.IPR[q->ipr].BIT.IPR > emu.icu.IPR[emu.irq[best].ipr].BIT.IPR) {
+				best = i;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+
+		emu.icu.IR[emu.irq[best].vect].BIT.IR = 0;
+		emu.stats.interrupts++;
+		if (emu.irq[best].isr) {
+			emu.in_isr = 1;
+			emu.irq[best].isr();
+			if (emu.pending != EMU_NO_DEV) {
+				emu_commit();
+			}
+			emu.in_isr = 0;
+		}
+		emu.irq_raised = 1;
+	}
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Register access from the firmware                              */
+/***********************************************************************/
+void *emu_io(enum emu_dev dev)
+{
+	struct st_port *p;
+	unsigned char sw;
+
+	if (emu.pending != EMU_NO_DEV) {
+		emu_commit();
+	}
+
+	emu.now += emu.cfg.access_cycles;
+	emu.stats.accesses++;
+	if (emu.now >= emu.next_event) {
+		emu_events();
+	}
+	if (emu.irq_raised && !emu.in_isr) {
+		emu_deliver();
+	}
+	emu.last_access = emu.now;
+
+	/* Present inputs and running counters */
+	switch (dev) {
+	case EMU_PORT4:
+		p = &emu.port[EMU_PORT4 - EMU_PORT1];
+		sw = emu.cfg.sensor_fn ? emu.cfg.sensor_fn(emu.cfg.ctx, emu.now) : emu.cfg.sensor;
+		p->PORT.BYTE = (unsigned char)~sw;
+		break;
+
+	case EMU_PORT6:
+		p = &emu.port[EMU_PORT6 - EMU_PORT1];
+		sw = emu.cfg.dipsw;
+		p->PORT.BYTE = (unsigned char)((sw & 1) << 3 | (sw & 2) << 1 | (sw & 4) >> 1 | (sw & 8) >> 3);
+		break;
+
+	case EMU_PORT7:
+		p = &emu.port[EMU_PORT7 - EMU_PORT1];
+		p->PORT.BYTE = (unsigned char)((p->DR.BYTE & 0xfe) | (emu.now < emu.cfg.pushsw_until ? 0 : 1));
+		break;
+
+	case EMU_MTU1:
+	case EMU_MTU2:
+		if (emu.enc[dev - EMU_MTU1].running) {
+			emu.enc[dev - EMU_MTU1].placed = emu_enc_count(dev - EMU_MTU1);
+			emu.mtu1[dev - EMU_MTU1].TCNT = emu.enc[dev - EMU_MTU1].placed;
+		}
+		break;
+
+	case EMU_SYSTEM:
+	case EMU_DTC:
+	case EMU_S12AD0:
+	case EMU_S12AD1:
+		emu_adc_catch_up_all(emu.now);
+		break;
+
+	case EMU_ICU:
+		emu_adc_route(emu.adc_route);
+		break;
+
+	case EMU_CMT0:
+	case EMU_CMT1:
+	case EMU_CMT2:
+	case EMU_CMT3:
+		if (emu.cmt_ch[dev - EMU_CMT0].running) {
+			struct emu_cmt *c = &emu.cmt_ch[dev - EMU_CMT0];
+			c->placed = emu_cmt_count(c, emu.now);
+			emu.cmt0[dev - EMU_CMT0].CMCNT = c->placed;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	emu.pending = dev;
+	return emu.dev[dev];
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		WAIT instruction: sleep until the next interrupt               */
+/***********************************************************************/
+void emu_wait(void)
+{
+	unsigned long long n = emu.stats.interrupts;
+
+	if (emu.pending != EMU_NO_DEV) {
+		emu_commit();
+	}
+	emu.irq_enabled = 1;
+
+	while (emu.stats.interrupts == n) {
+		if (emu.irq_raised) {
+			emu_deliver();
+			if (emu.stats.interrupts != n) {
+				break;
+			}
+		}
+		if (emu.next_event == emu.stop_at && !emu.cfg.step_fn) {
+			emu.stop_reason = EMU_STOP_HALT;
+			longjmp(emu.stop, 1);
+		}
+		if (emu.next_event > emu.now) {
+			emu.now = emu.next_event;
+		}
+		emu_events();
+	}
+	emu.last_access = emu.now;
+}
+
+void emu_set_interrupt_mask(int enabled)
+{
+	emu.irq_enabled = enabled;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Host interface                                                 */
+/***********************************************************************/
+void emu_reset(const struct emu_config *config)
+{
+	int i;
+
+	memset(&emu, 0, sizeof(emu));
+	emu.cfg = *config;
+	if (!emu.cfg.access_cycles) {
+		emu.cfg.access_cycles = EMU_DEFAULT_ACCESS_CYCLES;
+	}
+	if (emu.cfg.step_fn && !emu.cfg.step_cycles) {
+		emu.cfg.step_cycles = EMU_MS(1);
+	}
+	emu.next_step = emu.cfg.step_cycles;
+	emu.pending = EMU_NO_DEV;
+	emu.irq_enabled = 1;		// PowerON_Reset_PC sets PSW.I before main()
+
+	emu.system.MSTPCRA.LONG = 0xffffffff;	// all modules stopped
+	for (i = 0; i < 4; i++) {
+		emu.cmt0[i].CMCOR = 0xffff;
+		emu.cmt_ch[i].cmcor = 0xffff;
+	}
+	for (i = 0; i <= EMU_PORTE - EMU_PORT1; i++) {
+		emu.port[i].PORT.BYTE = 0xff;		// pull-ups
+	}
+	emu.mtu3.TGRA = emu.mtu3.TGRB = emu.mtu3.TGRC = emu.mtu3.TGRD = 0xffff;
+	emu.mtu4.TGRA = emu.mtu4.TGRB = emu.mtu4.TGRC = emu.mtu4.TGRD = 0xffff;
+	emu.gpt0[0].GTCCRC = emu.gpt0[1].GTCCRC = 0xffff;
+	emu.out[EMU_MOTOR_LEFT] = emu.out[EMU_MOTOR_RIGHT] = emu.out[EMU_SERVO] = 0xffff;
+	for (i = 0; i < EMU_ADC_UNITS; i++) {
+		emu.adc[i].due = EMU_NEVER;
+	}
+
+	emu.irq[EMU_IRQ_CMI0] = (struct emu_irq){ 28, 0x03, 4, 0x04, Excep_CMT0_CMI0 };
+	emu.irq[EMU_IRQ_CMI1] = (struct emu_irq){ 29, 0x03, 5, 0x05, Excep_CMT1_CMI1 };
+	emu.irq[EMU_IRQ_CMI2] = (struct emu_irq){ 30, 0x03, 6, 0x06, Excep_CMT2_CMI2 };
+	emu.irq[EMU_IRQ_CMI3] = (struct emu_irq){ 31, 0x03, 7, 0x07, Excep_CMT3_CMI3 };
+	emu.irq[EMU_IRQ_S12ADI0] = (struct emu_irq){ 102, 0x0c, 6, 0x48, Excep_S12AD0_S12ADI0 };
+	emu.irq[EMU_IRQ_S12ADI1] = (struct emu_irq){ 103, 0x0c, 7, 0x48, Excep_S12AD1_S12ADI1 };
+	emu.irq[EMU_IRQ_GTCIV1] = (struct emu_irq){ 184, 0x17, 0, 0x6b, Excep_GPT1_GTCIV1 };
+	emu.irq[EMU_IRQ_GTCIV2] = (struct emu_irq){ 190, 0x17, 6, 0x6d, Excep_GPT2_GTCIV2 };
+
+	emu.dev[EMU_SYSTEM] = &emu.system;
+	emu.dev[EMU_ICU] = &emu.icu;
+	emu.dev[EMU_CMT] = &emu.cmt;
+	emu.dev[EMU_DTC] = &emu.dtc;
+	emu.dev[EMU_GPT] = &emu.gpt;
+	emu.dev[EMU_GPT1] = &emu.gpt0[0];
+	emu.dev[EMU_GPT2] = &emu.gpt0[1];
+	emu.dev[EMU_S12AD0] = &emu.s12ad[0];
+	emu.dev[EMU_S12AD1] = &emu.s12ad[1];
+	emu.dev[EMU_IOPORT] = &emu.ioport;
+	emu.dev[EMU_MTU] = &emu.mtu;
+	emu.dev[EMU_MTU1] = &emu.mtu1[EMU_ENCODER_LEFT];
+	emu.dev[EMU_MTU2] = &emu.mtu1[EMU_ENCODER_RIGHT];
+	emu.dev[EMU_MTU3] = &emu.mtu3;
+	emu.dev[EMU_MTU4] = &emu.mtu4;
+	for (i = 0; i < 4; i++) {
+		emu.dev[EMU_CMT0 + i] = &emu.cmt0[i];
+	}
+	for (i = 0; i <= EMU_PORTE - EMU_PORT1; i++) {
+		emu.dev[EMU_PORT1 + i] = &emu.port[i];
+	}
+}
+
+enum emu_stop emu_run(void (*entry)(void), emu_time_t duration)
+{
+	emu.stop_at = emu.now + duration;
+	emu.stop_reason = EMU_STOP_TIME;
+	emu_schedule();
+
+	if (!setjmp(emu.stop)) {
+		emu.running = 1;
+		entry();
+		emu.stop_reason = EMU_STOP_RETURN;
+	}
+	emu.running = 0;
+	emu.in_isr = 0;
+	if (emu.pending != EMU_NO_DEV) {
+		emu_commit();
+	}
+	emu_adc_catch_up_all(emu.now);		// scans of the last batch, for the stats
+	return emu.stop_reason;
+}
+
+void emu_request_stop(void)
+{
+	emu.stop_reason = EMU_STOP_REQUEST;
+	emu.stop_at = emu.now;
+	emu.next_event = emu.now;
+}
+
+emu_time_t emu_now(void)
+{
+	return emu.now;
+}
+
+unsigned short emu_actuator(enum emu_actuator actuator)
+{
+	return emu.out[actuator];
+}
+
+/* MTU3 counts ICLK (2 PCLK) / 1, 4, 16, 64, 256, 1024; external clocks unused */
+emu_time_t emu_servo_frame(void)
+{
+	static const unsigned int mtu_iclk_divisor[8] = { 1, 4, 16, 64, 256, 1024, 0, 0 };
+
+	if (emu.mtu3.TGRA == 0xffff) {
+		return 0;			// reset value, the servo PWM is not set up
+	}
+	return ((emu_time_t)emu.mtu3.TGRA + 1) * mtu_iclk_divisor[emu.mtu3.TCR.BYTE & 7] / 2;
+}
+
+const struct emu_stats *emu_stats(void)
+{
+	return &emu.stats;
+}
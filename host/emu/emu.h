@@ -0,0 +1,195 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   emu/emu.h                                  */
+/*  File Contents:          RX62T peripheral emulator                  */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Runs the unmodified firmware on the build host. The register blocks
+* declared in emu/iodefine.h live in emulator memory; every access goes
+* through emu_io(), which
+*  - advances the emulated clock by emu_config.access_cycles,
+*  - records actuator writes (motor PWM, direction signals, servo, LEDs)
+*    with the time they were made,
+*  - counts CMT0 and raises CMI0, calling Excep_CMT0_CMI0() exactly like
+*    the CPU would between two instructions,
+*  - feeds the line sensor byte into PORT4,
+*  - counts the wheel encoders in MTU1/MTU2 phase counting mode, only
+*    while their MTCLKA-D pins are inputs with the input buffer on and
+*    selected by PFCMTU (TCLKS 0: P33-P30),
+*  - counts GPT1/GPT2 (saw-wave, up) and raises GTCIV1/GTCIV2 at
+*    their cycle end,
+*  - scans S12AD0/S12AD1 and runs the DTC transfers their scan end
+*    requests start (normal, repeat and block mode, no chains).
+*
+* Periodic events nothing observes cost nothing: the scans between two
+* S12ADI that reach the CPU are converted in one batch when the batch
+* ends or the firmware accesses S12AD, DTC, ICU or MSTPCRA, whichever
+* comes first. That holds as long as the firmware changes DTC transfer
+* information in RAM only while its DTCE bit is 0 and reads the
+* transferred results after an interrupt or an S12AD access, like
+* hal_rx62t.h does.
+* Likewise a GPT cycle end is only scheduled while it raises GTCIV.
+*
+* Time is counted in PCLK cycles (49.152 MHz after init()).
+*
+* Usage:
+*	emu_reset(&config);
+*	emu_run(firmware_main, EMU_MS(5000));
+*
+* The emulator state is per thread, like the firmware globals (HAL_STATE
+* in hal.h). A thread runs one emulated MCU; to start the firmware again
+* from its initial values, run it in a new thread or copy the initial
+* thread local block back like kit12_sweep does.
+**/
+
+#ifndef EMU_H
+#define EMU_H
+
+#define EMU_PCLK_HZ		49152000UL	// PCLK after init(): 12.288MHz*4
+#define EMU_US(us)		((emu_time_t)(us) * (EMU_PCLK_HZ / 1000) / 1000)
+#define EMU_MS(ms)		((emu_time_t)(ms) * (EMU_PCLK_HZ / 1000))
+
+typedef unsigned long long emu_time_t;
+
+/* Register blocks, the argument of emu_io() */
+enum emu_dev {
+	EMU_SYSTEM,
+	EMU_ICU,
+	EMU_CMT,
+	EMU_CMT0,
+	EMU_CMT1,
+	EMU_CMT2,
+	EMU_CMT3,
+	EMU_DTC,
+	EMU_GPT,
+	EMU_GPT1,
+	EMU_GPT2,
+	EMU_IOPORT,
+	EMU_MTU,
+	EMU_MTU1,
+	EMU_MTU2,
+	EMU_MTU3,
+	EMU_MTU4,
+	EMU_PORT1,
+	EMU_PORT2,
+	EMU_PORT3,
+	EMU_PORT4,
+	EMU_PORT5,
+	EMU_PORT6,
+	EMU_PORT7,
+	EMU_PORT8,
+	EMU_PORT9,
+	EMU_PORTA,
+	EMU_PORTB,
+	EMU_PORTD,
+	EMU_PORTE,
+	EMU_S12AD0,
+	EMU_S12AD1,
+	EMU_DEV_COUNT
+};
+
+/* Captured actuator outputs */
+enum emu_actuator {
+	EMU_MOTOR_LEFT,		// GPT1.GTCCRC
+	EMU_MOTOR_RIGHT,	// GPT2.GTCCRC
+	EMU_SERVO,			// MTU3.TGRD
+	EMU_MOTOR_DIR,		// PORT7.DR bit 4 (left), bit 5 (right): 1 reverse
+	EMU_LED,			// motor drive board LEDs, 1: lit
+	EMU_ACTUATOR_COUNT
+};
+
+struct emu_write {
+	emu_time_t time;
+	unsigned char actuator;		// enum emu_actuator
+	unsigned short value;
+};
+
+/* Wheel encoders, MTU1 and MTU2 in phase counting mode */
+enum emu_encoder {
+	EMU_ENCODER_LEFT,	// MTU1.TCNT
+	EMU_ENCODER_RIGHT,	// MTU2.TCNT
+	EMU_ENCODER_COUNT
+};
+
+/* DTC transfer information as the firmware lays it out in RAM, same
+   fields as struct hal_dtc_info in hal_rx62t.h, pointers of host width */
+struct emu_dtc_info {
+	unsigned char mra;
+	unsigned char mrb;
+	unsigned short reserved;
+	volatile void *volatile sar;
+	volatile void *volatile dar;
+	unsigned short cra;
+	volatile unsigned short crb;
+};
+
+/* Why emu_run() returned */
+enum emu_stop {
+	EMU_STOP_TIME,		// duration elapsed
+	EMU_STOP_REQUEST,	// emu_request_stop() from a callback
+	EMU_STOP_HALT,		// wait() with no interrupt source left
+	EMU_STOP_RETURN		// firmware entry function returned
+};
+
+struct emu_config {
+	/* Emulated PCLK cycles charged per register access, stands for the
+	   instructions the CPU executes between two peripheral accesses */
+	unsigned int access_cycles;
+
+	/* Inputs; sensor bit 7: leftmost .. bit 0: rightmost, 1: line */
+	unsigned char sensor;
+	unsigned char dipsw;		// 0 to 15
+	emu_time_t pushsw_until;	// motor drive board button held until then
+
+	/* Optional line sensor source, overrides sensor */
+	unsigned char (*sensor_fn)(void *ctx, emu_time_t now);
+
+	/* Optional wheel encoder source: phase counting edges since reset,
+	   forward positive; without it the encoders stand still */
+	long (*encoder_fn)(void *ctx, enum emu_encoder encoder, emu_time_t now);
+
+	/* Optional analog source, 12 bit result of channel 0-3 (AN000-AN003,
+	   S12AD0) and 4-7 (AN100-AN103, S12AD1); without it all read 0xfff.
+	   Called once per batch of scans with the time of the last one, so
+	   its levels may only change in step_fn (a batch ends before it) */
+	unsigned short (*analog_fn)(void *ctx, int channel, emu_time_t now);
+
+	/* Optional notification for every actuator write */
+	void (*write_fn)(void *ctx, const struct emu_write *w);
+
+	/* Optional host model stepped every step_cycles of emulated time */
+	void (*step_fn)(void *ctx, emu_time_t now);
+	emu_time_t step_cycles;
+
+	/* Optional write log */
+	struct emu_write *log;
+	unsigned long log_size;
+
+	void *ctx;
+};
+
+struct emu_stats {
+	unsigned long long accesses;
+	unsigned long long interrupts;
+	unsigned long long dtc_transfers;	// activations, not units moved
+	unsigned long long writes[EMU_ACTUATOR_COUNT];
+	unsigned long log_count;	// entries stored in config.log
+};
+
+void emu_reset(const struct emu_config *config);
+enum emu_stop emu_run(void (*entry)(void), emu_time_t duration);
+void emu_request_stop(void);
+
+emu_time_t emu_now(void);
+unsigned short emu_actuator(enum emu_actuator actuator);
+emu_time_t emu_servo_frame(void);	// MTU3 servo PWM period, 0: not set up yet
+int emu_encoder_pins(enum emu_encoder encoder);	// 1: its MTCLK pins reach the MTU
+const struct emu_stats *emu_stats(void);
+
+/* Used by emu/iodefine.h and emu/machine.h */
+void *emu_io(enum emu_dev dev);
+void emu_wait(void);
+void emu_set_interrupt_mask(int enabled);
+
+#endif /* EMU_H */
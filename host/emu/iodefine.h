@@ -0,0 +1,401 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   emu/iodefine.h                             */
+/*  File Contents:          Stand-in iodefine.h for the RX62T emulator */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Declares the subset of the RX62T I/O registers used by the firmware
+* with the same names as the Renesas iodefine.h, but every module macro
+* (PORT4, CMT0, MTU3, ...) expands to a call into the emulator, which
+* advances the emulated clock, delivers pending interrupts and returns
+* the emulated register block.
+*
+* It is force-included (gcc/clang -include) and uses the include guard
+* of the real header, so the #include "iodefine.h" in hal_rx62t.h
+* resolves to nothing and the firmware is compiled unchanged.
+*
+* Bit fields are declared LSB first (gcc/clang on little endian hosts),
+* the real header uses #pragma bit_order left with the same names.
+**/
+
+#ifndef __RX62TIODEFINE_HEADER__
+#define __RX62TIODEFINE_HEADER__
+
+#include "emu.h"
+
+#define EMU_BITS8(a, b, c, d, e, f, g, h) \
+	unsigned char a:1; unsigned char b:1; unsigned char c:1; unsigned char d:1; \
+	unsigned char e:1; unsigned char f:1; unsigned char g:1; unsigned char h:1;
+
+struct st_system {
+	union {
+		unsigned long LONG;
+		struct {
+			unsigned long :8;
+			unsigned long PCK:4;
+			unsigned long :12;
+			unsigned long ICK:4;
+			unsigned long :4;
+		} BIT;
+	} SCKCR;
+	union {
+		unsigned long LONG;
+		struct {
+			unsigned long MSTPA0:1;
+			unsigned long MSTPA1:1;
+			unsigned long MSTPA2:1;
+			unsigned long MSTPA3:1;
+			unsigned long MSTPA4:1;
+			unsigned long MSTPA5:1;
+			unsigned long MSTPA6:1;
+			unsigned long MSTPA7:1;
+			unsigned long MSTPA8:1;
+			unsigned long MSTPA9:1;
+			unsigned long MSTPA10:1;
+			unsigned long MSTPA11:1;
+			unsigned long MSTPA12:1;
+			unsigned long MSTPA13:1;
+			unsigned long MSTPA14:1;
+			unsigned long MSTPA15:1;
+			unsigned long MSTPA16:1;
+			unsigned long MSTPA17:1;
+			unsigned long MSTPA18:1;
+			unsigned long MSTPA19:1;
+			unsigned long MSTPA20:1;
+			unsigned long MSTPA21:1;
+			unsigned long MSTPA22:1;
+			unsigned long MSTPA23:1;
+			unsigned long MSTPA24:1;
+			unsigned long MSTPA25:1;
+			unsigned long MSTPA26:1;
+			unsigned long MSTPA27:1;
+			unsigned long MSTPA28:1;
+			unsigned long MSTPA29:1;
+			unsigned long MSTPA30:1;
+			unsigned long MSTPA31:1;
+		} BIT;
+	} MSTPCRA;
+};
+
+/* All ports share one layout in the emulator */
+struct st_port {
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(B0, B1, B2, B3, B4, B5, B6, B7) } BIT;
+	} DDR;
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(B0, B1, B2, B3, B4, B5, B6, B7) } BIT;
+	} DR;
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(B0, B1, B2, B3, B4, B5, B6, B7) } BIT;
+	} PORT;
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(B0, B1, B2, B3, B4, B5, B6, B7) } BIT;
+	} ICR;
+};
+
+struct st_ioport {
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char MTUS0:1;
+			unsigned char MTUS1:1;
+			unsigned char :4;
+			unsigned char TCLKS:2;
+		} BIT;
+	} PFCMTU;
+};
+
+struct st_icu {
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char IR:1;
+			unsigned char :7;
+		} BIT;
+	} IR[256];
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char DTCE:1;
+			unsigned char :7;
+		} BIT;
+	} DTCER[256];
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(IEN0, IEN1, IEN2, IEN3, IEN4, IEN5, IEN6, IEN7) } BIT;
+	} IER[32];
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char IPR:4;
+			unsigned char :4;
+		} BIT;
+	} IPR[144];
+};
+
+struct st_cmt {
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short STR0:1;
+			unsigned short STR1:1;
+			unsigned short :14;
+		} BIT;
+	} CMSTR0;
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short STR2:1;
+			unsigned short STR3:1;
+			unsigned short :14;
+		} BIT;
+	} CMSTR1;
+};
+
+struct st_cmt0 {
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short CKS:2;
+			unsigned short :4;
+			unsigned short CMIE:1;
+			unsigned short :9;
+		} BIT;
+	} CMCR;
+	unsigned short CMCNT;
+	unsigned short CMCOR;
+};
+
+struct st_mtu {
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(CST0, CST1, CST2, B3, B4, B5, CST3, CST4) } BIT;
+	} TSTRA;
+	union {
+		unsigned char BYTE;
+	} TOCR1A;
+	union {
+		unsigned char BYTE;
+	} TOCR2A;
+	union {
+		unsigned char BYTE;
+	} TOERA;
+};
+
+/* MTU1 and MTU2 */
+struct st_mtu1 {
+	union {
+		unsigned char BYTE;
+	} TCR;
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char MD:4;
+			unsigned char :4;
+		} BIT;
+	} TMDR1;
+	union {
+		unsigned char BYTE;
+	} TIOR;
+	union {
+		unsigned char BYTE;
+	} TIER;
+	union {
+		unsigned char BYTE;
+	} TSR;
+	unsigned short TCNT;
+	unsigned short TGRA;
+	unsigned short TGRB;
+};
+
+/* MTU3 and MTU4 (the real device interleaves them at one base) */
+struct st_mtu3 {
+	union {
+		unsigned char BYTE;
+	} TCR;
+	union {
+		unsigned char BYTE;
+	} TMDR1;
+	union {
+		unsigned char BYTE;
+	} TIORH;
+	union {
+		unsigned char BYTE;
+	} TIORL;
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(TGIEA, TGIEB, TGIEC, TGIED, TCIEV, B5, B6, TTGE) } BIT;
+	} TIER;
+	union {
+		unsigned char BYTE;
+		struct { EMU_BITS8(TGFA, TGFB, TGFC, TGFD, TCFV, B5, B6, B7) } BIT;
+	} TSR;
+	unsigned short TCNT;
+	unsigned short TGRA;
+	unsigned short TGRB;
+	unsigned short TGRC;
+	unsigned short TGRD;
+};
+
+struct st_gpt {
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short CST0:1;
+			unsigned short CST1:1;
+			unsigned short CST2:1;
+			unsigned short CST3:1;
+			unsigned short :12;
+		} BIT;
+	} GTSTR;
+};
+
+/* GPT0 to GPT3, the registers the firmware uses */
+struct st_gpt0 {
+	union {
+		unsigned short WORD;
+	} GTIOR;
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short GTINTA:1;
+			unsigned short GTINTB:1;
+			unsigned short GTINTC:1;
+			unsigned short GTINTD:1;
+			unsigned short GTINTE:1;
+			unsigned short GTINTF:1;
+			unsigned short GTINTPR:2;
+			unsigned short :8;
+		} BIT;
+	} GTINTAD;
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short MD:3;
+			unsigned short :5;
+			unsigned short TPCS:2;
+			unsigned short :6;
+		} BIT;
+	} GTCR;
+	union {
+		unsigned short WORD;
+	} GTBER;
+	union {
+		unsigned short WORD;
+	} GTUDC;
+	unsigned short GTCNT;
+	unsigned short GTCCRA;
+	unsigned short GTCCRC;
+	unsigned short GTPR;
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short :14;
+			unsigned short OAE:1;
+			unsigned short OBE:1;
+		} BIT;
+	} GTONCR;
+};
+
+/* S12AD0 and S12AD1, the registers the firmware uses */
+struct st_s12ad0 {
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char EXTRG:1;
+			unsigned char TRGE:1;
+			unsigned char CKS:2;
+			unsigned char ADIE:1;
+			unsigned char ADCS:2;
+			unsigned char ADST:1;
+		} BIT;
+	} ADCSR;
+	union {
+		unsigned short WORD;
+		struct {
+			unsigned short :12;
+			unsigned short CH:2;
+			unsigned short :2;
+		} BIT;
+	} ADANS;
+	unsigned short ADDR0A;
+	unsigned short ADDR1;
+	unsigned short ADDR2;
+	unsigned short ADDR3;
+};
+
+struct st_dtc {
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char :4;
+			unsigned char RRS:1;
+			unsigned char :3;
+		} BIT;
+	} DTCCR;
+	void *DTCVBR;
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char SHORT:1;
+			unsigned char :7;
+		} BIT;
+	} DTCADMOD;
+	union {
+		unsigned char BYTE;
+		struct {
+			unsigned char DTCST:1;
+			unsigned char :7;
+		} BIT;
+	} DTCST;
+};
+
+#define	CMT		(*(volatile struct st_cmt    *)emu_io(EMU_CMT))
+#define	CMT0	(*(volatile struct st_cmt0   *)emu_io(EMU_CMT0))
+#define	CMT1	(*(volatile struct st_cmt0   *)emu_io(EMU_CMT1))
+#define	CMT2	(*(volatile struct st_cmt0   *)emu_io(EMU_CMT2))
+#define	CMT3	(*(volatile struct st_cmt0   *)emu_io(EMU_CMT3))
+#define	DTC		(*(volatile struct st_dtc    *)emu_io(EMU_DTC))
+#define	GPT		(*(volatile struct st_gpt    *)emu_io(EMU_GPT))
+#define	GPT1	(*(volatile struct st_gpt0   *)emu_io(EMU_GPT1))
+#define	GPT2	(*(volatile struct st_gpt0   *)emu_io(EMU_GPT2))
+#define	ICU		(*(volatile struct st_icu    *)emu_io(EMU_ICU))
+#define	IOPORT	(*(volatile struct st_ioport *)emu_io(EMU_IOPORT))
+#define	MTU		(*(volatile struct st_mtu    *)emu_io(EMU_MTU))
+#define	MTU1	(*(volatile struct st_mtu1   *)emu_io(EMU_MTU1))
+#define	MTU2	(*(volatile struct st_mtu1   *)emu_io(EMU_MTU2))
+#define	MTU3	(*(volatile struct st_mtu3   *)emu_io(EMU_MTU3))
+#define	MTU4	(*(volatile struct st_mtu3   *)emu_io(EMU_MTU4))
+#define	PORT1	(*(volatile struct st_port   *)emu_io(EMU_PORT1))
+#define	PORT2	(*(volatile struct st_port   *)emu_io(EMU_PORT2))
+#define	PORT3	(*(volatile struct st_port   *)emu_io(EMU_PORT3))
+#define	PORT4	(*(volatile struct st_port   *)emu_io(EMU_PORT4))
+#define	PORT5	(*(volatile struct st_port   *)emu_io(EMU_PORT5))
+#define	PORT6	(*(volatile struct st_port   *)emu_io(EMU_PORT6))
+#define	PORT7	(*(volatile struct st_port   *)emu_io(EMU_PORT7))
+#define	PORT8	(*(volatile struct st_port   *)emu_io(EMU_PORT8))
+#define	PORT9	(*(volatile struct st_port   *)emu_io(EMU_PORT9))
+#define	PORTA	(*(volatile struct st_port   *)emu_io(EMU_PORTA))
+#define	PORTB	(*(volatile struct st_port   *)emu_io(EMU_PORTB))
+#define	PORTD	(*(volatile struct st_port   *)emu_io(EMU_PORTD))
+#define	PORTE	(*(volatile struct st_port   *)emu_io(EMU_PORTE))
+#define	S12AD0	(*(volatile struct st_s12ad0 *)emu_io(EMU_S12AD0))
+#define	S12AD1	(*(volatile struct st_s12ad0 *)emu_io(EMU_S12AD1))
+#define	SYSTEM	(*(volatile struct st_system *)emu_io(EMU_SYSTEM))
+
+#define	MSTP_DTC	SYSTEM.MSTPCRA.BIT.MSTPA28
+#define	MSTP_S12AD0	SYSTEM.MSTPCRA.BIT.MSTPA17
+#define	MSTP_S12AD1	SYSTEM.MSTPCRA.BIT.MSTPA16
+#define	MSTP_CMT0	SYSTEM.MSTPCRA.BIT.MSTPA15
+#define	MSTP_CMT1	SYSTEM.MSTPCRA.BIT.MSTPA15
+#define	MSTP_CMT2	SYSTEM.MSTPCRA.BIT.MSTPA14
+#define	MSTP_CMT3	SYSTEM.MSTPCRA.BIT.MSTPA14
+#define	MSTP_MTU	SYSTEM.MSTPCRA.BIT.MSTPA9
+#define	MSTP_GPT	SYSTEM.MSTPCRA.BIT.MSTPA7
+
+#endif
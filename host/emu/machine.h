@@ -0,0 +1,33 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   emu/machine.h                              */
+/*  File Contents:          Stand-in for the RXC intrinsic functions   */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+
+#ifndef EMU_MACHINE_H
+#define EMU_MACHINE_H
+
+#include "emu.h"
+
+/* WAIT instruction: sleep until the next interrupt */
+static inline void wait(void)
+{
+	emu_wait();
+}
+
+static inline void nop(void)
+{
+}
+
+static inline void setpsw_i(void)
+{
+	emu_set_interrupt_mask(1);
+}
+
+static inline void clrpsw_i(void)
+{
+	emu_set_interrupt_mask(0);
+}
+
+#endif /* EMU_MACHINE_H */
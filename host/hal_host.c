@@ -0,0 +1,10 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   hal_host.c                                 */
+/*  File Contents:          Storage of the host HAL backend            */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+
+#include "hal.h"
+
+HAL_STATE struct hal_host_io hal_host;
@@ -0,0 +1,265 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   kit12_bench.c                              */
+/*  File Contents:          Host timing of firmware control path parts */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Times pieces of the control path of kit12_rx62t.c built with the host
+* HAL backend, in ns per call. Host numbers only compare two versions
+* of the same code, they do not predict RX62T cycles: the host has a
+* double precision FPU, the RX62T calls the runtime library for double.
+*
+* Usage: kit12_bench [-n iterations]
+*  -n  calls per benchmark (default 10000000)
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fixed.h"
+#include "hal.h"
+#include "tuning.h"
+
+/* Firmware (libkit12_host.a) */
+void sensor_sample(void);
+unsigned char sensor_inp(unsigned char mask);
+int check_crossline(void);
+int check_rightline(void);
+int check_leftline(void);
+extern const unsigned char sensorClass[256];
+void state_step(void);
+extern HAL_STATE int pattern;
+
+#define MASK3_3		0xe7
+
+static volatile unsigned long sink;
+
+static double host_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Pattern 11 sensor classification                               */
+/***********************************************************************/
+
+/* check_* chain and MASK3_3 switch as pattern 11 had them */
+static unsigned char classify_chain(void)
+{
+	int event;
+	enum trace_row row;
+
+	event = check_crossline() ? 0x10 : check_rightline() ? 0x20 : check_leftline() ? 0x30 : 0;
+	switch (sensor_inp(MASK3_3)) {
+	case 0x00: row = TRACE_00; break;
+	case 0x04: row = TRACE_04; break;
+	case 0x06: row = TRACE_06; break;
+	case 0x07: row = TRACE_07; break;
+	case 0x03: row = TRACE_03; break;
+	case 0x20: row = TRACE_20; break;
+	case 0x60: row = TRACE_60; break;
+	case 0xe0: row = TRACE_E0; break;
+	case 0xc0: row = TRACE_C0; break;
+	case 0x01: row = TRACE_01; break;
+	default: row = TRACE_ROWS; break;
+	}
+	return (unsigned char)(event | row);
+}
+
+static void bench_classify_chain(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		hal_host.sensor = (unsigned char)(i * 37);
+		sensor_sample();
+		sink += classify_chain();
+	}
+}
+
+static void bench_classify_table(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		hal_host.sensor = (unsigned char)(i * 37);
+		sensor_sample();
+		sink += sensorClass[hal_host.sensor];
+	}
+}
+
+/* Table and chain agree on every frame (line lost aside) */
+static int check_classify(void)
+{
+	int s, bad = 0;
+
+	for (s = 0; s < 256; s++) {
+		hal_host.sensor = (unsigned char)s;
+		sensor_sample();
+		if ((sensorClass[s] & ~0x40) != classify_chain()) {
+			printf("  frame 0x%02x: table 0x%02x, chain 0x%02x\n", s, sensorClass[s], classify_chain());
+			bad++;
+		}
+	}
+	return bad;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		State machine pass                                             */
+/***********************************************************************/
+
+/* Normal trace, frames cycle through all traceTable rows */
+static void bench_state_step(unsigned long n)
+{
+	static const unsigned char frames[] = {
+		0x18, 0x1c, 0x0c, 0x0e, 0x06, 0x38, 0x30, 0x70, 0x60, 0x03
+	};
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		hal_host.sensor = frames[i % sizeof(frames)];
+		sensor_sample();
+		pattern = 11;
+		state_step();
+	}
+	sink += pattern;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Q16.16 against the double expressions it replaced              */
+/***********************************************************************/
+
+/* Operands through volatiles, so neither version folds to a constant */
+static volatile double speedFactorDouble = 0.7;
+static volatile fx_t speedFactorFixed = FX_RATIO(7, 10);
+static volatile int gapMm = 90;
+
+/* motor(): accele_l = accele_l * speedFactor */
+static void bench_motor_double(unsigned long n)
+{
+	unsigned long i;
+	double f = speedFactorDouble;
+
+	for (i = 0; i < n; i++) {
+		sink += (int)(((int)(i % 201) - 100) * f);
+	}
+}
+
+static void bench_motor_fixed(unsigned long n)
+{
+	unsigned long i;
+	fx_t f = speedFactorFixed;
+
+	for (i = 0; i < n; i++) {
+		sink += fx_mul_int(f, (int)(i % 201) - 100);
+	}
+}
+
+/* Cross line: measuredSpeed = gapDistance / cnt0, crankTimer = measuredSpeed * 110 */
+static void bench_speed_double(unsigned long n)
+{
+	unsigned long i;
+	double gap = gapMm, speed;
+
+	for (i = 0; i < n; i++) {
+		speed = gap / (double)(i % 1000 + 1);
+		sink += (int)(speed * 110);
+	}
+}
+
+static void bench_speed_fixed(unsigned long n)
+{
+	unsigned long i;
+	int gap = gapMm;
+	fx_t speed;
+
+	for (i = 0; i < n; i++) {
+		speed = fx_div_int(gap, (int)(i % 1000 + 1));
+		sink += fx_mul_int(speed, 110);
+	}
+}
+
+/* Both versions within 1 of each other over the benchmarked operands */
+static int check_fixed(void)
+{
+	int p, c, a, b, bad = 0;
+
+	for (p = -100; p <= 100; p++) {
+		a = (int)(p * speedFactorDouble);
+		b = fx_mul_int(speedFactorFixed, p);
+		if (abs(a - b) > 1) {
+			printf("  motor %d: double %d, fixed %d\n", p, a, b);
+			bad++;
+		}
+	}
+	for (c = 1; c <= 1000; c++) {
+		a = (int)((double)gapMm / c * 110);
+		b = fx_mul_int(fx_div_int(gapMm, c), 110);
+		if (abs(a - b) > 1) {
+			printf("  cnt0 %d: double %d, fixed %d\n", c, a, b);
+			bad++;
+		}
+	}
+	return bad;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Runner                                                         */
+/***********************************************************************/
+struct bench {
+	const char *name;
+	void (*run)(unsigned long n);
+};
+
+static const struct bench benches[] = {
+	{ "classify: check_* chain", bench_classify_chain },
+	{ "classify: sensorClass[]", bench_classify_table },
+	{ "state_step: normal trace", bench_state_step },
+	{ "motor scale: double", bench_motor_double },
+	{ "motor scale: fx_mul_int", bench_motor_fixed },
+	{ "crank speed: double", bench_speed_double },
+	{ "crank speed: fx_div_int", bench_speed_fixed },
+};
+
+int main(int argc, char **argv)
+{
+	unsigned long n = 10000000;
+	double t0, t1;
+	int c;
+	size_t i;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n': n = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (check_classify()) {
+		fprintf(stderr, "%s: sensorClass does not match the check_* chain\n", argv[0]);
+		return 1;
+	}
+	if (check_fixed()) {
+		fprintf(stderr, "%s: Q16.16 results differ from double by more than 1\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		t0 = host_seconds();
+		benches[i].run(n);
+		t1 = host_seconds();
+		printf("%-32s %8.2f ns\n", benches[i].name, (t1 - t0) * 1e9 / n);
+	}
+	return 0;
+}
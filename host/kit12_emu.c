@@ -0,0 +1,113 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   kit12_emu.c                                */
+/*  File Contents:          Run the firmware on the RX62T emulator     */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Runs main() of kit12_rx62t.c on the emulator with a fixed line sensor
+* pattern and reports the actuator writes and the emulation speed.
+*
+* Usage: kit12_emu [-t ms] [-s sensor] [-p ms] [-d dipsw] [-c cycles] [-l]
+*  -t  emulated run time in ms (default 10000)
+*  -s  line sensor byte, bit 7: leftmost (default 0x18, centered)
+*  -p  hold the motor drive board button for this many ms (default 10)
+*  -d  DIP switch value (default 0)
+*  -c  PCLK cycles charged per register access (default 16)
+*  -l  print the actuator write log
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emu.h"
+
+#define LOG_SIZE	100000
+
+void firmware_main(void);
+
+static const char *const actuator_name[EMU_ACTUATOR_COUNT] = {
+	"motor_left", "motor_right", "servo", "motor_dir", "led"
+};
+
+static const char *const stop_name[] = {
+	"time", "request", "halt", "return"
+};
+
+static double host_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+	struct emu_config cfg = { 0 };
+	const struct emu_stats *st;
+	unsigned long duration_ms = 10000;
+	unsigned long push_ms = 10;
+	int print_log = 0;
+	enum emu_stop why;
+	double t0, t1, emulated;
+	unsigned long i;
+	int opt;
+
+	cfg.sensor = 0x18;
+	while ((opt = getopt(argc, argv, "t:s:p:d:c:l")) != -1) {
+		switch (opt) {
+		case 't': duration_ms = strtoul(optarg, NULL, 0); break;
+		case 's': cfg.sensor = (unsigned char)strtoul(optarg, NULL, 0); break;
+		case 'p': push_ms = strtoul(optarg, NULL, 0); break;
+		case 'd': cfg.dipsw = (unsigned char)strtoul(optarg, NULL, 0); break;
+		case 'c': cfg.access_cycles = (unsigned int)strtoul(optarg, NULL, 0); break;
+		case 'l': print_log = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-t ms] [-s sensor] [-p ms] [-d dipsw] [-c cycles] [-l]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	cfg.pushsw_until = EMU_MS(push_ms);
+	if (print_log) {
+		cfg.log = malloc(LOG_SIZE * sizeof(*cfg.log));
+		cfg.log_size = cfg.log ? LOG_SIZE : 0;
+	}
+
+	emu_reset(&cfg);
+	t0 = host_seconds();
+	why = emu_run(firmware_main, EMU_MS(duration_ms));
+	t1 = host_seconds();
+
+	st = emu_stats();
+	emulated = (double)emu_now() / EMU_PCLK_HZ;
+
+	if (print_log) {
+		for (i = 0; i < st->log_count; i++) {
+			printf("%12.6f %-12s %5u\n", (double)cfg.log[i].time / EMU_PCLK_HZ,
+				   actuator_name[cfg.log[i].actuator], cfg.log[i].value);
+		}
+	}
+
+	printf("stop:        %s\n", stop_name[why]);
+	printf("emulated:    %.3f s\n", emulated);
+	printf("host:        %.3f s (%.1fx real time)\n", t1 - t0, emulated / (t1 - t0));
+	printf("accesses:    %llu\n", st->accesses);
+	printf("interrupts:  %llu\n", st->interrupts);
+	printf("dtc:         %llu transfers\n", st->dtc_transfers);
+	for (i = 0; i < EMU_ACTUATOR_COUNT; i++) {
+		printf("%-12s %llu writes, now %u\n", actuator_name[i], st->writes[i], emu_actuator(i));
+	}
+
+	for (i = 0; i < EMU_ENCODER_COUNT; i++) {
+		if (!emu_encoder_pins((enum emu_encoder)i)) {
+			fprintf(stderr, "%s: %s encoder MTCLK pins not set up, MTU%d does not count\n",
+					argv[0], i == EMU_ENCODER_LEFT ? "left" : "right", (int)i + 1);
+		}
+	}
+
+	free(cfg.log);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   kit12_sim.c                                */
+/*  File Contents:          Drive the emulated firmware around a track */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Usage: kit12_sim [-f track] [-s straight] [-r radius] [-t s] [-n laps] [-d dipsw] [-h step]
+*  -f  track file (see sim/track.h), else a built-in oval
+*  -s  oval straight length in m (default 3.0)
+*  -r  oval curve radius in m (default 0.6)
+*  -t  emulated time limit in s (default 60)
+*  -n  laps (default 1)
+*  -d  DIP switch value (default 0)
+*  -h  integration step in s (default 0.0005)
+*
+* Built twice: kit12_sim runs the firmware on the RX62T emulator
+* (sim_run()), kit12_sim_ctl with SIM_CONTROL runs the HAL_HOST build
+* at the control rate (sim_run_control()), several times faster but
+* without the register level timing.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "actuator.h"
+#include "control.h"
+#include "emu.h"
+#include "odometry.h"
+#include "sim.h"
+
+#ifndef SIM_CONTROL
+#define SIM_CONTROL		0
+#endif
+
+void firmware_main(void);
+
+static double host_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+	struct track track;
+	struct sim_car car;
+	struct sim_options opt;
+	struct sim_result r;
+	double straight = 3.0, radius = 0.6;
+	double t0, t1, emulated, load;
+	const char *path = NULL;
+	char err[256];
+	int c;
+#if !SIM_CONTROL
+	int i;
+#endif
+
+	sim_car_default(&car);
+	sim_options_default(&opt);
+
+	while ((c = getopt(argc, argv, "f:s:r:t:n:d:h:")) != -1) {
+		switch (c) {
+		case 'f': path = optarg; break;
+		case 's': straight = atof(optarg); break;
+		case 'r': radius = atof(optarg); break;
+		case 't': opt.time_limit = atof(optarg); break;
+		case 'n': opt.laps = atoi(optarg); break;
+		case 'd': opt.dipsw = (unsigned char)strtoul(optarg, NULL, 0); break;
+		case 'h': opt.step = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-f track] [-s straight] [-r radius] [-t s] [-n laps] [-d dipsw] [-h step]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	t0 = host_seconds();
+	if (path) {
+		if (track_load(&track, path, err, sizeof(err))) {
+			fprintf(stderr, "%s: %s\n", argv[0], err);
+			return 1;
+		}
+	}
+	else if (track_build_oval(&track, straight, radius)) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	load = host_seconds() - t0;
+
+	t0 = host_seconds();
+#if SIM_CONTROL
+	sim_run_control(firmware_main, &track, &car, &opt, &r);
+#else
+	sim_run(firmware_main, &track, &car, &opt, &r);
+#endif
+	t1 = host_seconds();
+	emulated = r.end;
+
+	printf("track:       %.2f m, %d segments, %s, loaded in %.1f us\n", track.length, track.count,
+		   track.closed ? "closed" : "open", load * 1e6);
+	printf("result:      %s\n", r.finished ? "finished" : r.course_out ? "course out" :
+										  r.halted ? "halted" : "time limit");
+	printf("time:        %.3f s\n", r.time);
+	printf("distance:    %.3f m\n", r.distance);
+	printf("speed:       avg %.2f m/s, max %.2f m/s\n", r.avg_speed, r.max_speed);
+	printf("line losses: %u\n", r.line_losses);
+	printf("scrub:       %.3f m\n", r.scrub);
+	printf("skid steps:  %lu\n", r.skid_steps);
+	printf("odometry:    left %.3f m, right %.3f m, speed %.2f m/s\n",
+		   odometry.counts[WHEEL_LEFT] * ENCODER_UM_PER_COUNT * 1e-6,
+		   odometry.counts[WHEEL_RIGHT] * ENCODER_UM_PER_COUNT * 1e-6,
+		   odometry.speed_avg / 65536.0);
+	printf("control:     %lu steps, %lu misses, %lu skipped, wcet %.1f us, %.0f%% idle\n",
+		   controlStats.steps, controlStats.misses, controlStats.skipped,
+		   controlStats.wcet * 1e6 / HAL_HIRES_HZ,
+		   controlStats.steps ? 100.0 * controlStats.idle / (controlStats.steps * (double)controlStats.period) : 0.0);
+	printf("actuator:    %lu commands, %lu applied, %lu overwritten\n",
+		   actuatorStats.commits, actuatorStats.applied, actuatorStats.overwritten);
+#if !SIM_CONTROL
+	printf("analog:      %llu DTC scan transfers, %llu interrupts in all\n",
+		   emu_stats()->dtc_transfers, emu_stats()->interrupts);
+#endif
+	printf("emulated:    %.3f s in %.3f s host (%.1fx real time)\n",
+		   emulated, t1 - t0, emulated / (t1 - t0));
+
+#if !SIM_CONTROL
+	for (i = 0; i < EMU_ENCODER_COUNT; i++) {
+		if (!emu_encoder_pins((enum emu_encoder)i)) {
+			fprintf(stderr, "%s: %s encoder MTCLK pins not set up, MTU%d does not count\n",
+					argv[0], i == EMU_ENCODER_LEFT ? "left" : "right", i + 1);
+		}
+	}
+#endif
+
+	track_free(&track);
+	return 0;
+}
@@ -0,0 +1,451 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   kit12_sweep.c                              */
+/*  File Contents:          Tune traceTable on the simulator           */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Runs the emulated firmware on a track once per candidate tuning (the
+* pattern 11 steering/motor values, see tuning.h) on all cores and ranks
+* the candidates by lap time and line losses. Candidate 0 is always the
+* tuning compiled into kit12_rx62t.c. kit12_sweep_ctl is the same sweep
+* at the control rate without the emulator (SIM_CONTROL, see sim.h),
+* about four times the runs per minute.
+*
+* The steering half follows LINE_PD: with it the steerGain kp/kd rows
+* are tuned and the traceTable angles, which nothing reads, stay as they
+* are; without it the angles are tuned. The powers are always tuned.
+*
+* Usage: kit12_sweep [-f track] [-n runs] [-g steps] [-a deg] [-p percent]
+*                    [-m power] [-j threads] [-t s] [-k top] [-r seed]
+*  -f  track file (see sim/track.h), else the built-in oval
+*  -n  random candidates: every entry moved by up to -a or -p, and -m
+*      (default 200)
+*  -g  grid instead: steps x steps candidates, all angles or gains scaled
+*      by 0.5 .. 1.5 and all drive powers scaled by 0.5 .. 1.5
+*  -a  random angle range in degrees (default 10), without LINE_PD
+*  -p  random kp/kd range in percent (default 30), with LINE_PD
+*  -m  random drive power range (default 20)
+*  -j  worker threads (default: online CPUs)
+*  -t  emulated time limit per run in s (default 30)
+*  -k  candidates printed (default 10)
+*  -r  random seed (default 1)
+*
+* The firmware globals and the emulator are thread local (HAL_STATE).
+* The workers live for the whole sweep and copy the initial values of
+* the program's thread locals back before every run, so each run starts
+* like a fresh thread without paying for one (kit12_sweep keeps no
+* thread locals of its own). They hand runs out of per-worker deques and
+* steal from each other when theirs is empty, so long runs (finished
+* laps) and short ones (early course outs) still keep every core busy.
+**/
+
+#define _GNU_SOURCE		// dl_iterate_phdr()
+#include <link.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emu.h"
+#include "sim.h"
+#include "tuning.h"
+
+#define SWEEP_MAX_THREADS	256
+
+#ifndef SIM_CONTROL
+#define SIM_CONTROL		0
+#endif
+
+void firmware_main(void);
+
+struct sweep_job {
+	struct trace_step table[TRACE_ROWS];
+	struct steer_gain gain[STEER_GAIN_ROWS];
+	struct sim_result r;
+	int id;
+};
+
+/* Job indices of one worker, owner pops the tail, thieves take the head */
+struct sweep_deque {
+	pthread_mutex_t lock;
+	int head, tail;
+	int *job;
+};
+
+struct sweep {
+	const struct track *track;
+	struct sim_car car;
+	struct sim_options opt;
+	struct sweep_job *jobs;
+	struct sweep_deque *deque;
+	int workers;
+};
+
+struct sweep_worker {
+	struct sweep *sw;
+	int id;
+	pthread_t thread;
+};
+
+static const char *const row_name[TRACE_ROWS] = {
+	"00", "04", "06", "07", "03", "20", "60", "e0", "c0", "01"
+};
+
+static double host_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Candidates                                                     */
+/***********************************************************************/
+static int sweep_clamp(int value, int lo, int hi)
+{
+	return value < lo ? lo : value > hi ? hi : value;
+}
+
+static int sweep_random(int base, int range)
+{
+	return base + rand() % (2 * range + 1) - range;
+}
+
+#if LINE_PD
+static fx_t sweep_scale(fx_t value, double scale)
+{
+	return (fx_t)(value * scale);
+}
+#endif
+
+static void sweep_make_random(struct sweep_job *job, int angle, int gain, int power)
+{
+	int i;
+
+	for (i = 0; i < TRACE_ROWS; i++) {
+#if !LINE_PD
+		job->table[i].angle = sweep_random(job->table[i].angle, angle);
+#endif
+		job->table[i].power = sweep_clamp(sweep_random(job->table[i].power, power), 0, 100);
+	}
+#if LINE_PD
+	for (i = 0; i < STEER_GAIN_ROWS; i++) {
+		job->gain[i].kp = sweep_scale(job->gain[i].kp, sweep_random(100, gain) / 100.0);
+		job->gain[i].kd = sweep_scale(job->gain[i].kd, sweep_random(100, gain) / 100.0);
+	}
+#endif
+	(void)angle;
+	(void)gain;
+}
+
+static void sweep_make_grid(struct sweep_job *job, double steer_scale, double power_scale)
+{
+	int i;
+
+	for (i = 0; i < TRACE_ROWS; i++) {
+#if !LINE_PD
+		job->table[i].angle = (int)(job->table[i].angle * steer_scale);
+#endif
+		job->table[i].power = sweep_clamp((int)(job->table[i].power * power_scale), 0, 100);
+	}
+#if LINE_PD
+	for (i = 0; i < STEER_GAIN_ROWS; i++) {
+		job->gain[i].kp = sweep_scale(job->gain[i].kp, steer_scale);
+		job->gain[i].kd = sweep_scale(job->gain[i].kd, steer_scale);
+	}
+#endif
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Work stealing pool                                             */
+/* Return values:                                                      */
+/*		job index, -1 when every deque is empty                        */
+/***********************************************************************/
+static int sweep_take(struct sweep *sw, int self)
+{
+	struct sweep_deque *q = &sw->deque[self];
+	int i, job = -1;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail) {
+		job = q->job[--q->tail];
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	/* Steal the oldest job of the next worker that has one */
+	for (i = 1; job < 0 && i < sw->workers; i++) {
+		q = &sw->deque[(self + i) % sw->workers];
+		pthread_mutex_lock(&q->lock);
+		if (q->head < q->tail) {
+			job = q->job[q->head++];
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	return job;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Thread locals of the program back to their initial values      */
+/* Return values:                                                      */
+/*		0, -1 without a thread local block                             */
+/***********************************************************************/
+struct sweep_tls {
+	const char *image;		// initial values (.tdata)
+	char *data;				// this thread's copy
+	size_t init, size;		// .tdata, .tdata + .tbss
+};
+
+/* The program comes first, the shared libraries keep their own blocks */
+static int sweep_tls_find(struct dl_phdr_info *info, size_t size, void *arg)
+{
+	struct sweep_tls *tls = arg;
+	int i;
+
+	for (i = 0; i < info->dlpi_phnum; i++) {
+		const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+
+		if (ph->p_type == PT_TLS) {
+			tls->image = (const char *)(info->dlpi_addr + ph->p_vaddr);
+			tls->data = info->dlpi_tls_data;
+			tls->init = ph->p_filesz;
+			tls->size = ph->p_memsz;
+		}
+	}
+	(void)size;
+	return 1;
+}
+
+static int sweep_tls_init(struct sweep_tls *tls)
+{
+	memset(tls, 0, sizeof(*tls));
+	dl_iterate_phdr(sweep_tls_find, tls);
+	return tls->data ? 0 : -1;
+}
+
+/* What a new thread starts with, without the thread */
+static void sweep_tls_reset(const struct sweep_tls *tls)
+{
+	memcpy(tls->data, tls->image, tls->init);
+	memset(tls->data + tls->init, 0, tls->size - tls->init);
+}
+
+static void *sweep_worker(void *arg)
+{
+	struct sweep_worker *w = arg;
+	struct sweep_tls tls;
+	struct sweep_job *job;
+	int i;
+
+	if (sweep_tls_init(&tls)) {
+		return NULL;
+	}
+	while ((i = sweep_take(w->sw, w->id)) >= 0) {
+		job = &w->sw->jobs[i];
+		sweep_tls_reset(&tls);
+		memcpy(traceTable, job->table, sizeof(traceTable));
+		memcpy(steerGain, job->gain, sizeof(steerGain));
+#if SIM_CONTROL
+		sim_run_control(firmware_main, w->sw->track, &w->sw->car, &w->sw->opt, &job->r);
+#else
+		sim_run(firmware_main, w->sw->track, &w->sw->car, &w->sw->opt, &job->r);
+#endif
+	}
+	return NULL;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Ranking: finished laps by time, then line losses,              */
+/*		the rest by distance                                           */
+/***********************************************************************/
+static int sweep_compare(const void *pa, const void *pb)
+{
+	const struct sim_result *a = &((const struct sweep_job *)pa)->r;
+	const struct sim_result *b = &((const struct sweep_job *)pb)->r;
+
+	if (a->finished != b->finished) {
+		return b->finished - a->finished;
+	}
+	if (a->finished && a->time != b->time) {
+		return a->time < b->time ? -1 : 1;
+	}
+	if (a->line_losses != b->line_losses) {
+		return a->line_losses < b->line_losses ? -1 : 1;
+	}
+	if (a->distance != b->distance) {
+		return a->distance > b->distance ? -1 : 1;
+	}
+	return 0;
+}
+
+static void sweep_print(int rank, const struct sweep_job *job)
+{
+	const struct sim_result *r = &job->r;
+	int i;
+
+	printf("%4d  #%-5d %-10s %7.3f s %7.2f m %5u  ", rank, job->id,
+		   r->finished ? "finished" : r->course_out ? "course out" : r->halted ? "halted" : "time limit",
+		   r->time, r->distance, r->line_losses);
+#if LINE_PD
+	for (i = 0; i < TRACE_ROWS; i++) {
+		printf(" %s:%d", row_name[i], job->table[i].power);
+	}
+	for (i = 0; i < STEER_GAIN_ROWS; i++) {
+		printf(" %dm/s:%.2f/%.4f", i, job->gain[i].kp / 65536.0, job->gain[i].kd / 65536.0);
+	}
+#else
+	for (i = 0; i < TRACE_ROWS; i++) {
+		printf(" %s:%d/%d", row_name[i], job->table[i].angle, job->table[i].power);
+	}
+#endif
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	static struct sweep_worker worker[SWEEP_MAX_THREADS];
+	struct sweep sw;
+	struct sweep_tls tls;
+	struct track track;
+	const char *path = NULL;
+	char err[256];
+	int runs = 200, grid = 0, angle = 10, gain = 30, power = 20, top = 10;
+	unsigned int seed = 1;
+	double t0, t1, emulated = 0;
+	int c, i, n;
+
+	memset(&sw, 0, sizeof(sw));
+	sim_car_default(&sw.car);
+	sim_options_default(&sw.opt);
+	sw.opt.time_limit = 30;
+	sw.workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "f:n:g:a:p:m:j:t:k:r:")) != -1) {
+		switch (c) {
+		case 'f': path = optarg; break;
+		case 'n': runs = atoi(optarg); break;
+		case 'g': grid = atoi(optarg); break;
+		case 'a': angle = atoi(optarg); break;
+		case 'p': gain = atoi(optarg); break;
+		case 'm': power = atoi(optarg); break;
+		case 'j': sw.workers = atoi(optarg); break;
+		case 't': sw.opt.time_limit = atof(optarg); break;
+		case 'k': top = atoi(optarg); break;
+		case 'r': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-f track] [-n runs] [-g steps] [-a deg] [-p percent] "
+					"[-m power] [-j threads] [-t s] [-k top] [-r seed]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (sw.workers < 1) {
+		sw.workers = 1;
+	}
+	if (sw.workers > SWEEP_MAX_THREADS) {
+		sw.workers = SWEEP_MAX_THREADS;
+	}
+	if (angle < 0 || gain < 0 || gain > 100 || power < 0) {
+		fprintf(stderr, "%s: -a and -m must not be negative, -p must be 0 to 100\n", argv[0]);
+		return 2;
+	}
+
+	if (path ? track_load(&track, path, err, sizeof(err)) :
+			   track_build_oval(&track, 3.0, 0.6)) {
+		fprintf(stderr, "%s: %s\n", argv[0], path ? err : "out of memory");
+		return 1;
+	}
+	sw.track = &track;
+
+	/* Candidates, #0 is the compiled in table */
+	n = grid > 0 ? grid * grid + 1 : runs + 1;
+	sw.jobs = calloc(n, sizeof(*sw.jobs));
+	sw.deque = calloc(sw.workers, sizeof(*sw.deque));
+	if (!sw.jobs || !sw.deque) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	srand(seed);
+	for (i = 0; i < n; i++) {
+		sw.jobs[i].id = i;
+		memcpy(sw.jobs[i].table, traceTable, sizeof(traceTable));
+		memcpy(sw.jobs[i].gain, steerGain, sizeof(steerGain));
+		if (i == 0) {
+			continue;
+		}
+		if (grid > 0) {
+			sweep_make_grid(&sw.jobs[i],
+							0.5 + (grid > 1 ? (double)((i - 1) / grid) / (grid - 1) : 0.5),
+							0.5 + (grid > 1 ? (double)((i - 1) % grid) / (grid - 1) : 0.5));
+		}
+		else {
+			sweep_make_random(&sw.jobs[i], angle, gain, power);
+		}
+	}
+
+	/* Deal the jobs round robin */
+	for (i = 0; i < sw.workers; i++) {
+		pthread_mutex_init(&sw.deque[i].lock, NULL);
+		sw.deque[i].job = malloc((n / sw.workers + 1) * sizeof(int));
+		if (!sw.deque[i].job) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		struct sweep_deque *q = &sw.deque[i % sw.workers];
+		q->job[q->tail++] = i;
+	}
+
+	if (sweep_tls_init(&tls)) {
+		fprintf(stderr, "%s: no thread local firmware state to reset\n", argv[0]);
+		return 1;
+	}
+
+	t0 = host_seconds();
+	for (i = 0; i < sw.workers; i++) {
+		worker[i].sw = &sw;
+		worker[i].id = i;
+		if (pthread_create(&worker[i].thread, NULL, sweep_worker, &worker[i])) {
+			fprintf(stderr, "%s: cannot start worker %d\n", argv[0], i);
+			return 1;
+		}
+	}
+	for (i = 0; i < sw.workers; i++) {
+		pthread_join(worker[i].thread, NULL);
+	}
+	t1 = host_seconds();
+
+	for (i = 0; i < n; i++) {
+		emulated += sw.jobs[i].r.time;
+	}
+	qsort(sw.jobs, n, sizeof(*sw.jobs), sweep_compare);
+
+	printf("track:       %.2f m, %d segments\n", track.length, track.count);
+	printf("runs:        %d on %d threads in %.2f s (%.0f runs/min, %.0fx real time)\n",
+		   n, sw.workers, t1 - t0, n * 60 / (t1 - t0), emulated / (t1 - t0));
+#if LINE_PD
+	printf("rank  run    result        time      distance  losses  table row:power, steerGain kp/kd\n");
+#else
+	printf("rank  run    result        time      distance  losses  table row:angle/power\n");
+#endif
+	for (i = 0; i < n; i++) {
+		if (i < top || sw.jobs[i].id == 0) {
+			sweep_print(i + 1, &sw.jobs[i]);
+		}
+	}
+
+	for (i = 0; i < sw.workers; i++) {
+		free(sw.deque[i].job);
+		pthread_mutex_destroy(&sw.deque[i].lock);
+	}
+	free(sw.deque);
+	free(sw.jobs);
+	track_free(&track);
+	return 0;
+}
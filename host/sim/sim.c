@@ -0,0 +1,92 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/sim.c                                  */
+/*  File Contents:          Kinematic car simulator on the emulator    */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+
+#include <string.h>
+
+#include "sim_model.h"
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Emulator callbacks                                             */
+/***********************************************************************/
+static unsigned char sim_sensor_fn(void *ctx, emu_time_t now)
+{
+	(void)now;
+	return ((struct sim_state *)ctx)->sensor;
+}
+
+static unsigned short sim_analog_fn(void *ctx, int channel, emu_time_t now)
+{
+	struct sim_state *s = ctx;
+
+	(void)now;
+	if (!s->analog_valid) {
+		sim_sense_analog(s);
+	}
+	return s->analog[channel];
+}
+
+static long sim_encoder_fn(void *ctx, enum emu_encoder encoder, emu_time_t now)
+{
+	(void)now;
+	return sim_encoder(ctx, encoder);
+}
+
+/* The actuator registers into the model, one sim step */
+static void sim_step(void *ctx, emu_time_t now)
+{
+	struct sim_state *s = ctx;
+	const struct emu_stats *st = emu_stats();
+	struct sim_outputs *o = &s->out;
+
+	o->motor_left = emu_actuator(EMU_MOTOR_LEFT);
+	o->motor_right = emu_actuator(EMU_MOTOR_RIGHT);
+	o->reverse = (unsigned char)emu_actuator(EMU_MOTOR_DIR);
+	o->servo = emu_actuator(EMU_SERVO);
+	o->servo_frame = emu_servo_frame();
+	o->written = (st->writes[EMU_MOTOR_LEFT] ? SIM_OUT_MOTOR_LEFT : 0) |
+				 (st->writes[EMU_MOTOR_RIGHT] ? SIM_OUT_MOTOR_RIGHT : 0) |
+				 (st->writes[EMU_SERVO] ? SIM_OUT_SERVO : 0);
+	if (sim_advance(s, now)) {
+		emu_request_stop();
+	}
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Run the firmware on a track                                    */
+/* Return values:                                                      */
+/*		0: run completed (see result), -1: empty track                 */
+/***********************************************************************/
+int sim_run(void (*firmware)(void), const struct track *t, const struct sim_car *car,
+			const struct sim_options *opt, struct sim_result *result)
+{
+	struct sim_state s;
+	struct emu_config cfg;
+	enum emu_stop why;
+
+	if (!t->count) {
+		return -1;
+	}
+	sim_begin(&s, t, car, opt, result);
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.dipsw = opt->dipsw;
+	cfg.pushsw_until = EMU_MS(SIM_PUSH_MS);
+	cfg.sensor_fn = sim_sensor_fn;
+	cfg.encoder_fn = sim_encoder_fn;
+	cfg.analog_fn = sim_analog_fn;
+	cfg.step_fn = sim_step;
+	cfg.step_cycles = (emu_time_t)(opt->step * EMU_PCLK_HZ);
+	cfg.ctx = &s;
+
+	emu_reset(&cfg);
+	why = emu_run(firmware, (emu_time_t)(opt->time_limit * EMU_PCLK_HZ));
+
+	sim_end(&s, emu_now(), why == EMU_STOP_HALT || why == EMU_STOP_RETURN);
+	return 0;
+}
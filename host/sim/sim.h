@@ -0,0 +1,88 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/sim.h                                  */
+/*  File Contents:          Kinematic car simulator                    */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Closes the loop around the emulated firmware: every sim step the
+* motor and servo counts the firmware wrote into GPT1/GPT2.GTCCRC and
+* MTU3.TGRD are turned into wheel speeds and a steering angle, a
+* kinematic bicycle model (wheelbase W, tread T of Car NR 2) moves the
+* car, and the 8 bit line sensor frame read from PORT4 is computed from
+* the new pose, as are the analog levels S12AD0/S12AD1 convert: the part
+* of each sensor's spot on the white line, between its black and white
+* level. The rear wheel travel drives the MTU1/MTU2 encoders.
+*
+* sim_run() pays for every register access of the firmware in
+* emu_io(), so it stays at a few hundred times real time on one core
+* (about 200x to 260x on the default oval). sim_run_control() runs the
+* HAL_HOST build of the firmware without the emulator (sim_control.c)
+* and is about four times faster; there the car and track model, two
+* sim steps and one set of analog levels per ms, takes most of the time.
+* Neither reaches thousands of times real time; a larger step (-h)
+* trades accuracy for speed in both.
+**/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "track.h"
+
+#define SIM_SENSORS		8
+
+/* Car NR 2 hardware, see sim_car_default() */
+struct sim_car {
+	double wheelbase;				// W
+	double tread;					// T
+	double sensor_ahead;			// sensor row ahead of the rear axle
+	double sensor_y[SIM_SENSORS];	// bit 7 .. bit 0, positive left
+	double sensor_spot;				// half width of a sensor's spot across the row
+	unsigned short analog_white[SIM_SENSORS];	// 12 bit level on the line, bit 7 .. bit 0
+	unsigned short analog_black[SIM_SENSORS];	// on the black floor
+
+	double v_max;					// wheel speed at 100% duty, m/s
+	double motor_tau;				// motor/car time constant, s
+	double servo_rate;				// servo slew rate, rad/s
+	double a_lat_max;				// tire grip limit, m/s^2
+
+	/* Actuator calibration, must match kit12_rx62t.c */
+	unsigned short motor_cycle;		// MOTOR_PWM_CYCLE
+	unsigned short servo_center;	// SERVO_CENTER
+	double servo_step;				// HANDLE_STEP, counts per degree
+	double frame;					// servo PWM period, a new angle takes effect;
+									// 0: the MTU3 period the firmware sets (SERVO_FRAME_US)
+	double motor_frame;				// motor PWM period, a new duty takes effect
+	double encoder_counts_per_m;	// ENCODER_COUNTS_PER_M, rear wheels
+};
+
+struct sim_options {
+	double time_limit;				// emulated seconds
+	double step;					// integration step, s
+	int laps;						// finish after this many laps of a closed track
+	unsigned char dipsw;
+};
+
+struct sim_result {
+	double end;						// emulated s from power on to the stop
+	double time;					// from first motor command to finish or stop
+	double distance;				// progress along the track
+	int finished;
+	int course_out;					// left the course, run stopped
+	int halted;						// firmware stopped with no interrupt source
+	unsigned int line_losses;		// sensor frame went to 0x00 on a painted line
+	double scrub;					// integrated wheel slip against the kinematic ideal, m
+	unsigned long skid_steps;		// steps at the grip limit
+	double max_speed;
+	double avg_speed;
+};
+
+void sim_car_default(struct sim_car *car);
+void sim_options_default(struct sim_options *opt);
+
+int sim_run(void (*firmware)(void), const struct track *t, const struct sim_car *car,
+			const struct sim_options *opt, struct sim_result *result);
+int sim_run_control(void (*firmware)(void), const struct track *t, const struct sim_car *car,
+					const struct sim_options *opt, struct sim_result *result);
+
+#endif /* SIM_H */
@@ -0,0 +1,166 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/sim_control.c                          */
+/*  File Contents:          Kinematic car simulator at control rate    */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* sim_run_control() closes the same loop as sim_run() around the
+* firmware built with the plain host backend (HAL_HOST, libkit12_host.a)
+* instead of the emulator. The firmware only hands over at
+* hal_wait_interrupt(); there the clock moves on to the next CMT0
+* compare match and the interrupt handlers that fall due run directly:
+*  - Excep_GPT1_GTCIV1() twice, the committed command and its direction
+*    signals go out,
+*  - every sim step Excep_CMT1_CMI1() samples the new sensor frame,
+*  - Excep_CMT2_CMI2() at every wrap of the 16 bit hires count,
+*  - Excep_CMT0_CMI0() at the end, with the analog levels of the pose.
+* The firmware itself takes no time and nothing is sampled between two
+* sim steps, so results are close to sim_run() but not identical.
+**/
+
+#include <setjmp.h>
+#include <string.h>
+
+#include "hal.h"
+#include "sim_model.h"
+
+/*======================================*/
+/* Symbol definitions                   */
+/*======================================*/
+#define SIM_HIRES_CYCLES	(EMU_PCLK_HZ / HAL_HIRES_HZ)	// CMT2, PCLK/8
+#define SIM_TICK_CYCLES		EMU_MS(1)						// CMT0 period
+
+void Excep_CMT0_CMI0(void);
+void Excep_CMT1_CMI1(void);
+void Excep_CMT2_CMI2(void);
+void Excep_GPT1_GTCIV1(void);
+
+struct sim_control {
+	struct sim_state s;
+	emu_time_t now;
+	emu_time_t next_step;
+	emu_time_t step;
+	emu_time_t limit;
+	unsigned long wraps;			// CMT2 interrupts run
+	jmp_buf stop;
+};
+
+/* Per thread, like the firmware globals and the emulator */
+static _Thread_local struct sim_control simControl;
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		CMT0 and CMT2 counts at c->now, CMI2 for every wrap            */
+/***********************************************************************/
+static void sim_control_clock(struct sim_control *c)
+{
+	emu_time_t hires = c->now / SIM_HIRES_CYCLES;
+
+	hal_host.tick_count = (unsigned short)(c->now % SIM_TICK_CYCLES * HAL_TICK_COUNTS / SIM_TICK_CYCLES);
+	hal_host.hires_count = (unsigned short)hires;
+	while (c->wraps < hires >> 16) {
+		c->wraps++;
+		Excep_CMT2_CMI2();
+	}
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		One sim step: the outputs into the model, its sensor frame     */
+/*		and encoders back                                              */
+/***********************************************************************/
+static void sim_control_step(struct sim_control *c)
+{
+	struct sim_state *s = &c->s;
+	struct sim_outputs *o = &s->out;
+
+	c->now = c->next_step;
+	c->next_step += c->step;
+	sim_control_clock(c);
+
+	o->motor_left = hal_host.motor_left;
+	o->motor_right = hal_host.motor_right;
+	o->reverse = hal_host.motor_reverse;
+	o->servo = hal_host.servo;
+	o->servo_frame = hal_host.pwm_cycle ? (emu_time_t)(hal_host.pwm_cycle + 1) * (EMU_PCLK_HZ / HAL_SERVO_HZ) : 0;
+	o->written = SIM_OUT_MOTOR_LEFT | SIM_OUT_MOTOR_RIGHT | SIM_OUT_SERVO;
+	if (sim_advance(s, c->now)) {
+		longjmp(c->stop, 1);
+	}
+
+	hal_host.sensor = s->sensor;
+	hal_host.encoder_left = (unsigned short)sim_encoder(s, EMU_ENCODER_LEFT);
+	hal_host.encoder_right = (unsigned short)sim_encoder(s, EMU_ENCODER_RIGHT);
+	Excep_CMT1_CMI1();
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		hal_wait_interrupt(): on to the next CMT0 compare match        */
+/***********************************************************************/
+static void sim_control_wait(void *ctx)
+{
+	struct sim_control *c = ctx;
+	emu_time_t tick = c->now - c->now % SIM_TICK_CYCLES + SIM_TICK_CYCLES;
+	int i;
+
+	/* Duties and servo at the first cycle end, the direction at the next */
+	Excep_GPT1_GTCIV1();
+	Excep_GPT1_GTCIV1();
+
+	while (c->next_step <= tick && c->next_step <= c->limit) {
+		sim_control_step(c);
+	}
+	if (tick >= c->limit) {
+		c->now = c->limit;
+		longjmp(c->stop, 1);
+	}
+	c->now = tick;
+	sim_control_clock(c);
+
+	hal_host.pushsw = c->now < EMU_MS(SIM_PUSH_MS);
+	sim_sense_analog(&c->s);
+	for (i = 0; i < SIM_SENSORS; i++) {
+		hal_host.analog[i] = c->s.analog[i];
+	}
+	Excep_CMT0_CMI0();
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Run the firmware on a track at the control rate                */
+/* Return values:                                                      */
+/*		0: run completed (see result), -1: empty track                 */
+/***********************************************************************/
+int sim_run_control(void (*firmware)(void), const struct track *t, const struct sim_car *car,
+					const struct sim_options *opt, struct sim_result *result)
+{
+	struct sim_control *c = &simControl;
+
+	if (!t->count) {
+		return -1;
+	}
+	memset(c, 0, sizeof(*c));
+	sim_begin(&c->s, t, car, opt, result);
+	c->step = (emu_time_t)(opt->step * EMU_PCLK_HZ);
+	c->next_step = c->step;
+	c->limit = (emu_time_t)(opt->time_limit * EMU_PCLK_HZ);
+
+	memset(&hal_host, 0, sizeof(hal_host));
+	hal_host.dipsw = opt->dipsw;
+	hal_host.pushsw = 1;
+	hal_host.sensor = c->s.sensor;
+	hal_host.wait_fn = sim_control_wait;
+	hal_host.wait_ctx = c;
+
+	if (!setjmp(c->stop)) {
+		firmware();
+		sim_end(&c->s, c->now, 1);		// main() returned
+	}
+	else {
+		sim_end(&c->s, c->now, 0);
+	}
+	hal_host.wait_fn = NULL;
+	return 0;
+}
@@ -0,0 +1,317 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/sim_model.c                            */
+/*  File Contents:          Car and track model of the simulator       */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "sim_model.h"
+
+/*======================================*/
+/* Symbol definitions                   */
+/*======================================*/
+#define SIM_DEG			(M_PI / 180)
+#define SIM_OUT_MARGIN	0.05	// rear axle this far past the course edge is out
+#define SIM_SPOT_POINTS	5		// line tests across a sensor spot
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Car NR 2 (PDF: 185)                                            */
+/***********************************************************************/
+void sim_car_default(struct sim_car *car)
+{
+	static const double sensor_y[SIM_SENSORS] = {
+		0.060, 0.040, 0.022, 0.007, -0.007, -0.022, -0.040, -0.060
+	};
+	/* Phototransistors and LEDs spread, no two sensors read alike */
+	static const unsigned short white[SIM_SENSORS] = {
+		620, 540, 700, 580, 650, 560, 690, 600
+	};
+	static const unsigned short black[SIM_SENSORS] = {
+		3420, 3300, 3550, 3380, 3480, 3350, 3500, 3400
+	};
+
+	car->wheelbase = 0.143;
+	car->tread = 0.155;
+	car->sensor_ahead = 0.23;
+	memcpy(car->sensor_y, sensor_y, sizeof(sensor_y));
+	car->sensor_spot = 0.005;
+	memcpy(car->analog_white, white, sizeof(white));
+	memcpy(car->analog_black, black, sizeof(black));
+
+	car->v_max = 3.2;
+	car->motor_tau = 0.12;
+	car->servo_rate = 500 * SIM_DEG;
+	car->a_lat_max = 9.0;
+
+	car->motor_cycle = 3071;
+	car->servo_center = 2038;
+	car->servo_step = 13;
+	car->frame = 0;							// from MTU3, follows SERVO_DIGITAL
+	car->motor_frame = 0.00025;
+	car->encoder_counts_per_m = 5000;		// 1e6 / ENCODER_UM_PER_COUNT
+}
+
+void sim_options_default(struct sim_options *opt)
+{
+	opt->time_limit = 60;
+	opt->step = 0.0005;
+	opt->laps = 1;
+	opt->dipsw = 0;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Actuator and sensor models                                     */
+/***********************************************************************/
+static double sim_duty(const struct sim_state *s, unsigned short count, int reverse)
+{
+	double duty = (double)count / s->car->motor_cycle;
+
+	if (duty > 1) {
+		duty = 1;
+	}
+	return reverse ? -duty : duty;
+}
+
+static void sim_latch_motors(struct sim_state *s)
+{
+	const struct sim_outputs *o = &s->out;
+
+	if (o->written & SIM_OUT_MOTOR_LEFT) {
+		s->duty_l = sim_duty(s, o->motor_left, o->reverse & 0x01);
+	}
+	if (o->written & SIM_OUT_MOTOR_RIGHT) {
+		s->duty_r = sim_duty(s, o->motor_right, o->reverse & 0x02);
+	}
+}
+
+static void sim_latch_servo(struct sim_state *s)
+{
+	if (s->out.written & SIM_OUT_SERVO) {
+		/* handle(): positive angle turns right, count = center - angle * step */
+		s->steer_cmd = -((double)s->car->servo_center - s->out.servo) /
+					   s->car->servo_step * SIM_DEG;
+	}
+}
+
+/* Point k of SIM_SPOT_POINTS across the spot of the sensor at y */
+static int sim_spot_is_line(const struct sim_state *s, double sx, double sy, double n, double c,
+							double y, int k)
+{
+	double d = y + s->car->sensor_spot * (2.0 * k / (SIM_SPOT_POINTS - 1) - 1);
+
+	return track_is_line_near(s->t, s->near, s->near_count, sx - d * n, sy + d * c);
+}
+
+static void sim_sense(struct sim_state *s)
+{
+	const struct sim_car *car = s->car;
+	double c = cos(s->heading), n = sin(s->heading);
+	double sx = s->x + car->sensor_ahead * c;
+	double sy = s->y + car->sensor_ahead * n;
+	unsigned char frame = 0;
+	struct track_pos pos;
+	int i;
+
+	s->near_count = track_near(s->t, s->hint, sx, sy, s->reach, s->near);
+	for (i = 0; i < SIM_SENSORS; i++) {
+		double px = sx - car->sensor_y[i] * n;
+		double py = sy + car->sensor_y[i] * c;
+		if (track_is_line_near(s->t, s->near, s->near_count, px, py)) {
+			frame |= 0x80 >> i;
+		}
+	}
+
+	/* No line to lose in the gap of a lane change */
+	if (frame == 0 && s->sensor != 0 && s->t_start >= 0 &&
+		s->t->seg[track_locate(s->t, s->hint, sx, sy, &pos)].painted) {
+		s->r->line_losses++;
+	}
+	s->sensor = frame;
+	s->analog_valid = 0;
+}
+
+/* Analog levels of the current pose, only computed when the loop asks */
+void sim_sense_analog(struct sim_state *s)
+{
+	const struct sim_car *car = s->car;
+	double c = cos(s->heading), n = sin(s->heading);
+	double sx = s->x + car->sensor_ahead * c;
+	double sy = s->y + car->sensor_ahead * n;
+	int i, k, on, lit;
+
+	for (i = 0; i < SIM_SENSORS; i++) {
+		/* Share of the spot on the line. A line is wider than
+		   the spot, if both edges agree with the center so does the rest */
+		on = (s->sensor >> (7 - i)) & 1;
+		lit = sim_spot_is_line(s, sx, sy, n, c, car->sensor_y[i], 0) +
+			  sim_spot_is_line(s, sx, sy, n, c, car->sensor_y[i], SIM_SPOT_POINTS - 1);
+		if (lit == 2 * on) {
+			lit = on * SIM_SPOT_POINTS;
+		}
+		else {
+			for (k = 1; k < SIM_SPOT_POINTS - 1; k++) {
+				lit += sim_spot_is_line(s, sx, sy, n, c, car->sensor_y[i], k);
+			}
+		}
+		s->analog[SIM_SENSORS - 1 - i] = (unsigned short)(car->analog_black[i] -
+			(car->analog_black[i] - car->analog_white[i]) * lit / SIM_SPOT_POINTS);
+	}
+	s->analog_valid = 1;
+}
+
+long sim_encoder(const struct sim_state *s, enum emu_encoder encoder)
+{
+	double d = (encoder == EMU_ENCODER_LEFT) ? s->dist_l : s->dist_r;
+
+	return (long)floor(d * s->car->encoder_counts_per_m);
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Fixed step: actuators -> kinematic bicycle -> sensors          */
+/* Return values:                                                      */
+/*		1: finished or course out, the run is over                     */
+/***********************************************************************/
+int sim_advance(struct sim_state *s, emu_time_t now)
+{
+	const struct sim_car *car = s->car;
+	struct sim_result *r = s->r;
+	double t = (double)now / EMU_PCLK_HZ;
+	double dt = s->dt;
+	double ds, v, yaw, yaw_max, max_steer;
+	emu_time_t frame;
+	struct track_pos pos;
+
+	/* The motor period is shorter than a step: latch once, skip the rest */
+	if (now >= s->next_motor_frame) {
+		sim_latch_motors(s);
+		while (s->next_motor_frame <= now) {
+			s->next_motor_frame += (emu_time_t)(car->motor_frame * EMU_PCLK_HZ);
+		}
+	}
+	if (now >= s->next_frame) {
+		sim_latch_servo(s);
+		frame = car->frame > 0 ? (emu_time_t)(car->frame * EMU_PCLK_HZ) : s->out.servo_frame;
+		s->next_frame += frame ? frame : (emu_time_t)(dt * EMU_PCLK_HZ);
+	}
+
+	/* Motors: first order response to the duty */
+	s->v_l += (s->duty_l * car->v_max - s->v_l) * dt / car->motor_tau;
+	s->v_r += (s->duty_r * car->v_max - s->v_r) * dt / car->motor_tau;
+
+	/* Servo: slew rate limited */
+	max_steer = car->servo_rate * dt;
+	if (s->steer_cmd - s->steer > max_steer) {
+		s->steer += max_steer;
+	}
+	else if (s->steer - s->steer_cmd > max_steer) {
+		s->steer -= max_steer;
+	}
+	else {
+		s->steer = s->steer_cmd;
+	}
+
+	/* Kinematic bicycle on the rear axle, understeer at the grip limit */
+	v = 0.5 * (s->v_l + s->v_r);
+	yaw = v * tan(s->steer) / car->wheelbase;
+	if (fabs(v) > 1e-3) {
+		yaw_max = car->a_lat_max / fabs(v);
+		if (fabs(yaw) > yaw_max) {
+			yaw = yaw > 0 ? yaw_max : -yaw_max;
+			r->skid_steps++;
+		}
+	}
+	r->scrub += fabs((s->v_r - s->v_l) - yaw * car->tread) * dt;
+	s->dist_l += s->v_l * dt;
+	s->dist_r += s->v_r * dt;
+
+	s->x += v * cos(s->heading) * dt;
+	s->y += v * sin(s->heading) * dt;
+	s->heading += yaw * dt;
+
+	if (s->t_start < 0 && (s->duty_l != 0 || s->duty_r != 0)) {
+		s->t_start = t;
+	}
+	if (fabs(v) > r->max_speed) {
+		r->max_speed = fabs(v);
+	}
+
+	/* Progress along the track */
+	s->hint = track_locate(s->t, s->hint, s->x, s->y, &pos);
+	ds = pos.s - s->last_s;
+	if (s->t->closed) {
+		if (ds < -0.5 * s->t->length) {
+			ds += s->t->length;
+		}
+		else if (ds > 0.5 * s->t->length) {
+			ds -= s->t->length;
+		}
+	}
+	s->last_s = pos.s;
+	s->progress += ds;
+
+	sim_sense(s);
+
+	if (fabs(pos.d) > TRACK_HALF_WIDTH + SIM_OUT_MARGIN) {
+		r->course_out = 1;
+	}
+	else if ((s->t->closed && s->progress >= s->opt->laps * s->t->length) ||
+			 (!s->t->closed && s->progress >= s->t->length)) {
+		r->finished = 1;
+	}
+	return r->course_out || r->finished;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Car on the start line, result cleared                          */
+/***********************************************************************/
+void sim_begin(struct sim_state *s, const struct track *t, const struct sim_car *car,
+			   const struct sim_options *opt, struct sim_result *result)
+{
+	struct track_pos pos;
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	memset(result, 0, sizeof(*result));
+	s->t = t;
+	s->car = car;
+	s->opt = opt;
+	s->r = result;
+	s->dt = opt->step;
+	s->t_start = -1;
+	for (i = 0; i < SIM_SENSORS; i++) {
+		if (fabs(car->sensor_y[i]) + car->sensor_spot > s->reach) {
+			s->reach = fabs(car->sensor_y[i]) + car->sensor_spot;
+		}
+	}
+
+	/* Rear axle on the start line, heading along the track */
+	s->x = t->seg[0].x;
+	s->y = t->seg[0].y;
+	s->heading = t->seg[0].heading;
+	s->hint = track_locate(t, 0, s->x, s->y, &pos);
+	s->last_s = pos.s;
+	sim_sense(s);
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Result of a run that stopped at now                            */
+/***********************************************************************/
+void sim_end(struct sim_state *s, emu_time_t now, int halted)
+{
+	struct sim_result *r = s->r;
+	double t_end = (double)now / EMU_PCLK_HZ;
+
+	r->halted = halted;
+	r->end = t_end;
+	r->time = (s->t_start < 0) ? 0 : t_end - s->t_start;
+	r->distance = s->progress;
+	r->avg_speed = r->time > 0 ? s->progress / r->time : 0;
+}
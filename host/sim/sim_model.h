@@ -0,0 +1,85 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/sim_model.h                            */
+/*  File Contents:          Car and track model of the simulator       */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* The half of the simulator that does not know how the firmware runs,
+* shared by the two loops around it: sim.c on the emulator and
+* sim_control.c at the control rate. Host programs use sim.h.
+*
+* A loop fills in sim_state.out with the actuator outputs of the
+* firmware before every sim_advance() and hands the sensor frame, the
+* analog levels and the encoder counts back to it afterwards. Time is
+* counted in PCLK cycles (emu_time_t) in both loops.
+**/
+
+#ifndef SIM_MODEL_H
+#define SIM_MODEL_H
+
+#include "emu.h"
+#include "sim.h"
+
+#define SIM_PUSH_MS			10		// start button held at power on
+
+/* sim_outputs.written */
+#define SIM_OUT_MOTOR_LEFT	0x01
+#define SIM_OUT_MOTOR_RIGHT	0x02
+#define SIM_OUT_SERVO		0x04
+
+/* Actuator outputs of the firmware */
+struct sim_outputs {
+	unsigned short motor_left;		// PWM count
+	unsigned short motor_right;
+	unsigned char reverse;			// bit 0: left, bit 1: right
+	unsigned short servo;			// MTU3.TGRD count
+	emu_time_t servo_frame;			// MTU3 period, 0: not set up yet
+	unsigned char written;			// SIM_OUT_* the firmware has put out
+};
+
+struct sim_state {
+	const struct track *t;
+	const struct sim_car *car;
+	const struct sim_options *opt;
+	struct sim_result *r;
+	struct sim_outputs out;
+
+	double dt;
+	emu_time_t next_frame;			// servo
+	emu_time_t next_motor_frame;
+
+	/* Commands latched at their PWM period */
+	double duty_l, duty_r;		// -1 .. 1
+	double steer_cmd;			// rad, positive left
+
+	/* Car */
+	double x, y, heading;
+	double v_l, v_r;			// rear wheels
+	double dist_l, dist_r;		// rear wheel travel, encoders
+	double steer;
+
+	/* Track progress */
+	int hint;
+	double last_s;
+	double progress;
+	double t_start;				// -1 until the first motor command
+
+	unsigned char sensor;
+	unsigned short analog[SIM_SENSORS];	// channel order: bit 0 .. bit 7
+	int analog_valid;					// analog matches the pose
+
+	/* Segments within reach of the sensor row of the pose */
+	double reach;				// farthest spot point from the row center
+	int near[TRACK_NEAR_MAX];
+	int near_count;
+};
+
+void sim_begin(struct sim_state *s, const struct track *t, const struct sim_car *car,
+			   const struct sim_options *opt, struct sim_result *result);
+int sim_advance(struct sim_state *s, emu_time_t now);
+void sim_sense_analog(struct sim_state *s);
+long sim_encoder(const struct sim_state *s, enum emu_encoder encoder);
+void sim_end(struct sim_state *s, emu_time_t now, int halted);
+
+#endif /* SIM_MODEL_H */
@@ -0,0 +1,407 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/track.c                                */
+/*  File Contents:          Track geometry for the simulator           */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "track.h"
+
+/*======================================*/
+/* Symbol definitions                   */
+/*======================================*/
+#define TRACK_MAX_ARC		(M_PI / 2)	// longer arcs are split, keeps atan2 unambiguous
+#define TRACK_LOST			0.5			// hint is stale beyond this distance
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Building                                                       */
+/***********************************************************************/
+void track_init(struct track *t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+void track_free(struct track *t)
+{
+	free(t->seg);
+	memset(t, 0, sizeof(*t));
+}
+
+static struct track_seg *track_append(struct track *t)
+{
+	struct track_seg *g;
+
+	if (t->count == t->size) {
+		int size = t->size ? t->size * 2 : 64;
+		g = realloc(t->seg, size * sizeof(*g));
+		if (!g) {
+			return NULL;
+		}
+		t->seg = g;
+		t->size = size;
+	}
+
+	g = &t->seg[t->count++];
+	memset(g, 0, sizeof(*g));
+	g->x = t->x;
+	g->y = t->y;
+	g->heading = t->heading;
+	g->cos_h = cos(t->heading);
+	g->sin_h = sin(t->heading);
+	g->s = t->length;
+	g->painted = 1;
+	return g;
+}
+
+int track_add_straight(struct track *t, double length)
+{
+	struct track_seg *g = track_append(t);
+
+	if (!g) {
+		return -1;
+	}
+	g->kind = TRACK_STRAIGHT;
+	g->length = length;
+
+	t->x += length * g->cos_h;
+	t->y += length * g->sin_h;
+	t->length += length;
+	return 0;
+}
+
+int track_add_arc(struct track *t, double radius, double angle)
+{
+	struct track_seg *g;
+	double part;
+
+	while (angle != 0) {
+		part = angle;
+		if (part > TRACK_MAX_ARC) {
+			part = TRACK_MAX_ARC;
+		}
+		if (part < -TRACK_MAX_ARC) {
+			part = -TRACK_MAX_ARC;
+		}
+		angle -= part;
+
+		g = track_append(t);
+		if (!g) {
+			return -1;
+		}
+		g->kind = TRACK_ARC;
+		g->curvature = (part > 0 ? 1.0 : -1.0) / radius;
+		g->length = radius * fabs(part);
+		g->cx = g->x - g->sin_h / g->curvature;
+		g->cy = g->y + g->cos_h / g->curvature;
+		g->ring_in2 = radius > TRACK_LINE_HALF_WIDTH ?
+					  (radius - TRACK_LINE_HALF_WIDTH) * (radius - TRACK_LINE_HALF_WIDTH) : 0;
+		g->ring_out2 = (radius + TRACK_LINE_HALF_WIDTH) * (radius + TRACK_LINE_HALF_WIDTH);
+
+		t->heading += part;
+		t->x = g->cx + sin(t->heading) / g->curvature;
+		t->y = g->cy - cos(t->heading) / g->curvature;
+		t->length += g->length;
+	}
+	return 0;
+}
+
+/* Sharp corner of the line (crank), the segments meet at one point */
+int track_add_corner(struct track *t, double angle)
+{
+	t->heading += angle;
+	return 0;
+}
+
+int track_add_mark(struct track *t, enum track_mark mark)
+{
+	if (track_add_straight(t, TRACK_MARK_LENGTH)) {
+		return -1;
+	}
+	t->seg[t->count - 1].mark = (unsigned char)mark;
+	return 0;
+}
+
+/* Unpainted diagonal to the line <offset> to the left (negative: right) */
+int track_add_lane_change(struct track *t, double offset, double length)
+{
+	double heading = t->heading;
+	double c = cos(heading), n = sin(heading);
+	int ret;
+
+	t->heading = heading + atan2(offset, length);
+	ret = track_add_straight(t, hypot(offset, length));
+	if (!ret) {
+		t->seg[t->count - 1].painted = 0;
+		t->x = t->seg[t->count - 1].x + length * c - offset * n;
+		t->y = t->seg[t->count - 1].y + length * n + offset * c;
+	}
+	t->heading = heading;
+	return ret;
+}
+
+void track_finish(struct track *t)
+{
+	double turns = t->heading / (2 * M_PI);
+
+	t->closed = t->count > 0 &&
+				hypot(t->x - t->seg[0].x, t->y - t->seg[0].y) < 1e-3 &&
+				fabs(turns - floor(turns + 0.5)) < 1e-6;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Queries                                                        */
+/***********************************************************************/
+
+/* Point in segment coordinates: a along the segment, d to the left */
+static void track_local(const struct track_seg *g, double x, double y, double *a, double *d)
+{
+	double dx, dy, rx0, ry0, r;
+
+	if (g->kind == TRACK_STRAIGHT) {
+		dx = x - g->x;
+		dy = y - g->y;
+		*a = dx * g->cos_h + dy * g->sin_h;
+		*d = dy * g->cos_h - dx * g->sin_h;
+		return;
+	}
+
+	rx0 = g->x - g->cx;
+	ry0 = g->y - g->cy;
+	dx = x - g->cx;
+	dy = y - g->cy;
+	*a = atan2(rx0 * dy - ry0 * dx, rx0 * dx + ry0 * dy) / g->curvature;
+	r = sqrt(dx * dx + dy * dy);
+	*d = (g->curvature > 0) ? (1.0 / g->curvature - r) : (r + 1.0 / g->curvature);
+}
+
+static int track_index(const struct track *t, int i)
+{
+	if (t->closed) {
+		return (i % t->count + t->count) % t->count;
+	}
+	return (i < 0 || i >= t->count) ? -1 : i;
+}
+
+/* First neighbour searched around a hint, may be off an open track */
+static int track_first(const struct track *t, int hint)
+{
+	return t->closed ? track_index(t, hint - TRACK_SEARCH_BACK) : hint - TRACK_SEARCH_BACK;
+}
+
+/* Neighbour after i, walks the search span without a division per step */
+static int track_next(const struct track *t, int i)
+{
+	if (++i == t->count && t->closed) {
+		i = 0;
+	}
+	return i;
+}
+
+/* Neighbours checked around a hint, each segment of a short closed track once */
+static int track_span(const struct track *t)
+{
+	int span = TRACK_NEAR_MAX;
+
+	return (t->closed && t->count < span) ? t->count : span;
+}
+
+/* Distance of a point from the segment including the part past its ends */
+static double track_distance(const struct track_seg *g, double a, double d)
+{
+	double out = 0;
+
+	if (a < 0) {
+		out = -a;
+	}
+	else if (a > g->length) {
+		out = a - g->length;
+	}
+	return fabs(d) + out;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Nearest point on the reference line                            */
+/* Arguments:                                                          */
+/*		hint: segment of the previous query, keeps this O(1)           */
+/* Return values:                                                      */
+/*		segment index, -1 for an empty track                           */
+/***********************************************************************/
+int track_locate(const struct track *t, int hint, double x, double y, struct track_pos *pos)
+{
+	int i, k, span, best = -1;
+	double a, d, dist, best_dist = 0, best_a = 0, best_d = 0;
+
+	if (!t->count) {
+		return -1;
+	}
+
+	span = track_span(t);
+	for (k = 0, i = track_first(t, hint); k < span; k++, i = track_next(t, i)) {
+		if (i < 0 || i >= t->count) {
+			continue;
+		}
+		track_local(&t->seg[i], x, y, &a, &d);
+		dist = track_distance(&t->seg[i], a, d);
+		if (best < 0 || dist < best_dist) {
+			best = i;
+			best_dist = dist;
+			best_a = a;
+			best_d = d;
+		}
+	}
+
+	/* Stale hint, search everything */
+	if (best < 0 || best_dist > TRACK_LOST) {
+		for (i = 0; i < t->count; i++) {
+			track_local(&t->seg[i], x, y, &a, &d);
+			dist = track_distance(&t->seg[i], a, d);
+			if (best < 0 || dist < best_dist) {
+				best = i;
+				best_dist = dist;
+				best_a = a;
+				best_d = d;
+			}
+		}
+	}
+
+	if (best_a < 0) {
+		best_a = 0;
+	}
+	if (best_a > t->seg[best].length) {
+		best_a = t->seg[best].length;
+	}
+	pos->seg = best;
+	pos->s = t->seg[best].s + best_a;
+	pos->d = best_d;
+	return best;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Segments with line or marks within reach of a point            */
+/* Arguments:                                                          */
+/*		segs: TRACK_NEAR_MAX entries                                   */
+/* Return values:                                                      */
+/*		number of segments in segs                                     */
+/***********************************************************************/
+int track_near(const struct track *t, int hint, double x, double y, double reach, int *segs)
+{
+	int i, k, span, n = 0;
+	double a, d, r, side;
+	const struct track_seg *g;
+	const double hw = TRACK_LINE_HALF_WIDTH;
+
+	span = track_span(t);
+	for (k = 0, i = track_first(t, hint); k < span; k++, i = track_next(t, i)) {
+		if (i < 0 || i >= t->count) {
+			continue;
+		}
+		g = &t->seg[i];
+
+		/* Arcs carry no marks, only the ring along their line */
+		if (g->kind == TRACK_ARC) {
+			r = sqrt((x - g->cx) * (x - g->cx) + (y - g->cy) * (y - g->cy));
+			if (!g->painted || r + reach < sqrt(g->ring_in2) || r - reach > sqrt(g->ring_out2)) {
+				continue;
+			}
+		}
+		else {
+			side = (g->mark != TRACK_MARK_NONE) ? TRACK_HALF_WIDTH : g->painted ? hw : -1;
+			track_local(g, x, y, &a, &d);
+			if (side < 0 || fabs(d) > side + reach ||
+				a < -hw - reach || a > g->length + hw + reach) {
+				continue;
+			}
+		}
+		segs[n++] = i;
+	}
+	return n;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Line sensor model                                              */
+/* Arguments:                                                          */
+/*		segs, n: track_near() of a point the query is within reach of  */
+/* Return values:                                                      */
+/*		1: point is on the white line                                  */
+/***********************************************************************/
+int track_is_line_near(const struct track *t, const int *segs, int n, double x, double y)
+{
+	int k;
+	double a, d, dx, dy, r2;
+	const struct track_seg *g;
+	const double hw = TRACK_LINE_HALF_WIDTH;
+
+	for (k = 0; k < n; k++) {
+		g = &t->seg[segs[k]];
+
+		/* Arcs carry no marks: off the ring along their line, no atan2 needed */
+		if (g->kind == TRACK_ARC) {
+			dx = x - g->cx;
+			dy = y - g->cy;
+			r2 = dx * dx + dy * dy;
+			if (r2 < g->ring_in2 || r2 > g->ring_out2) {
+				continue;
+			}
+		}
+		track_local(g, x, y, &a, &d);
+		if (g->painted && a >= -hw && a <= g->length + hw && fabs(d) <= hw) {
+			return 1;
+		}
+		if (g->mark == TRACK_MARK_NONE || a < 0 || a > g->length ||
+			(a > TRACK_MARK_WIDTH && a < g->length - TRACK_MARK_WIDTH)) {
+			continue;
+		}
+		switch (g->mark) {
+		case TRACK_MARK_CROSS:
+			if (fabs(d) <= TRACK_HALF_WIDTH) {
+				return 1;
+			}
+			break;
+		case TRACK_MARK_HALF_LEFT:
+			if (d >= 0 && d <= TRACK_HALF_WIDTH) {
+				return 1;
+			}
+			break;
+		case TRACK_MARK_HALF_RIGHT:
+			if (d <= 0 && d >= -TRACK_HALF_WIDTH) {
+				return 1;
+			}
+			break;
+		}
+	}
+	return 0;
+}
+
+int track_is_line(const struct track *t, int hint, double x, double y)
+{
+	int segs[TRACK_NEAR_MAX];
+
+	return track_is_line_near(t, segs, track_near(t, hint, x, y, 0, segs), x, y);
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Test oval                                                      */
+/***********************************************************************/
+int track_build_oval(struct track *t, double straight, double radius)
+{
+	track_init(t);
+	if (track_add_straight(t, straight) ||
+		track_add_arc(t, radius, M_PI) ||
+		track_add_straight(t, straight) ||
+		track_add_arc(t, radius, M_PI)) {
+		track_free(t);
+		return -1;
+	}
+	track_finish(t);
+	return 0;
+}
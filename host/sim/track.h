@@ -0,0 +1,120 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/track.h                                */
+/*  File Contents:          Track geometry for the simulator           */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* A track is an array of segments laid end to end along the reference
+* line. Every segment stores its start pose and the trigonometry the
+* sensor queries need, so a query only touches the segment the car is
+* on and its direct neighbours.
+*
+* Units: metres and radians. x/y is a right-handed plane, heading 0
+* points along +x, positive curvature turns left.
+*
+* Track files (track_load(), track_parse()) describe the course as one
+* element per line in driving order, lengths in m, angles in degrees,
+* '#' starts a comment:
+*
+*	straight <length>
+*	left <radius> <angle>               arc turning left
+*	right <radius> <angle>              arc turning right
+*	crank left|right                    90 degree corner of the line
+*	crossline                           double cross line
+*	halfline left|right                 double half line on that side
+*	lanechange left|right [offset] [length]
+*	                                    line ends, continues <offset>
+*	                                    to the side after <length>
+*	                                    (default 0.25 0.45)
+*
+* Cross and half lines are TRACK_MARK_LENGTH long: two TRACK_MARK_WIDTH
+* stripes, matching gapDistance in kit12_rx62t.c.
+**/
+
+#ifndef TRACK_H
+#define TRACK_H
+
+#define TRACK_LINE_HALF_WIDTH	0.010	// white center line 20mm
+#define TRACK_HALF_WIDTH		0.150	// course 300mm
+#define TRACK_MARK_WIDTH		0.020	// one stripe of a cross/half line
+#define TRACK_MARK_LENGTH		0.090	// first stripe start to second stripe end
+#define TRACK_LANE_OFFSET		0.250
+#define TRACK_LANE_LENGTH		0.450
+
+#define TRACK_SEARCH_BACK		3		// neighbours checked around the hint
+#define TRACK_SEARCH_AHEAD		3
+#define TRACK_NEAR_MAX			(TRACK_SEARCH_BACK + 1 + TRACK_SEARCH_AHEAD)
+
+enum track_kind {
+	TRACK_STRAIGHT,
+	TRACK_ARC
+};
+
+/* Markings across the course, always on straight segments */
+enum track_mark {
+	TRACK_MARK_NONE,
+	TRACK_MARK_CROSS,
+	TRACK_MARK_HALF_LEFT,
+	TRACK_MARK_HALF_RIGHT
+};
+
+struct track_seg {
+	/* Start pose of the reference line */
+	double x, y;
+	double cos_h, sin_h;
+	double heading;
+
+	double length;			// along the reference line
+	double curvature;		// 1/R, 0 for straights
+	double s;				// distance of the segment start from the start line
+
+	double cx, cy;			// arc center
+	double ring_in2, ring_out2;	// squared arc center distance of the line edges
+
+	unsigned char kind;		// enum track_kind
+	unsigned char mark;		// enum track_mark
+	unsigned char painted;	// center line present (not in a lane change)
+};
+
+struct track {
+	struct track_seg *seg;
+	int count;
+	int size;
+	int closed;				// last segment ends at the start pose
+	double length;
+
+	/* End pose, start of the next segment added */
+	double x, y, heading;
+};
+
+/* Position of a point relative to the reference line */
+struct track_pos {
+	int seg;
+	double s;				// distance from the start line
+	double d;				// lateral offset, positive left
+};
+
+void track_init(struct track *t);
+void track_free(struct track *t);
+int track_add_straight(struct track *t, double length);
+int track_add_arc(struct track *t, double radius, double angle);
+int track_add_corner(struct track *t, double angle);
+int track_add_mark(struct track *t, enum track_mark mark);
+int track_add_lane_change(struct track *t, double offset, double length);
+void track_finish(struct track *t);
+
+int track_parse(struct track *t, const char *text, char *err, int err_size);
+int track_load(struct track *t, const char *path, char *err, int err_size);
+
+int track_locate(const struct track *t, int hint, double x, double y, struct track_pos *pos);
+int track_is_line(const struct track *t, int hint, double x, double y);
+
+/* Line tests of many points around one: the segments are picked once */
+int track_near(const struct track *t, int hint, double x, double y, double reach, int *segs);
+int track_is_line_near(const struct track *t, const int *segs, int n, double x, double y);
+
+/* Test oval: two straights joined by two half circles, counterclockwise */
+int track_build_oval(struct track *t, double straight, double radius);
+
+#endif /* TRACK_H */
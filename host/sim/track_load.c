@@ -0,0 +1,202 @@
+/***********************************************************************/
+/*  Supported Microcontroller:none (Linux build host)                  */
+/*  File:                   sim/track_load.c                           */
+/*  File Contents:          Track file loader                          */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+* Compiles a track description (format in track.h) into the segment
+* array of struct track. Single pass, no allocation besides the array.
+**/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "track.h"
+
+/*======================================*/
+/* Symbol definitions                   */
+/*======================================*/
+#define TRACK_MAX_LINE	256
+#define TRACK_MAX_WORDS	8
+#define TRACK_DEG		(M_PI / 180)
+
+struct track_line {
+	int n;
+	char *word[TRACK_MAX_WORDS];
+};
+
+/* Split one line into words, drops the comment */
+static void track_split(char *line, struct track_line *l)
+{
+	char *p = strchr(line, '#');
+
+	if (p) {
+		*p = '\0';
+	}
+	l->n = 0;
+	for (p = strtok(line, " \t\r\n"); p && l->n < TRACK_MAX_WORDS; p = strtok(NULL, " \t\r\n")) {
+		l->word[l->n++] = p;
+	}
+}
+
+static int track_number(const char *word, double *value)
+{
+	char *end;
+
+	*value = strtod(word, &end);
+	return (end == word || *end != '\0' || !isfinite(*value)) ? -1 : 0;
+}
+
+/* left: +1, right: -1, else 0 */
+static int track_side(const char *word)
+{
+	if (!strcmp(word, "left")) {
+		return 1;
+	}
+	if (!strcmp(word, "right")) {
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		One element                                                    */
+/* Return values:                                                      */
+/*		0: ok, -1: error, message in err                               */
+/***********************************************************************/
+static int track_element(struct track *t, const struct track_line *l, char *err, int err_size)
+{
+	const char *op = l->word[0];
+	double v[2] = { 0, 0 };
+	int side, i, n = 0;
+
+	/* Numeric arguments after the keyword (and side) */
+	side = (l->n > 1) ? track_side(l->word[1]) : 0;
+	for (i = side ? 2 : 1; i < l->n; i++) {
+		if (n == 2 || track_number(l->word[i], &v[n])) {
+			snprintf(err, err_size, "bad argument '%s'", l->word[i]);
+			return -1;
+		}
+		n++;
+	}
+
+	if (!strcmp(op, "straight") && n == 1 && v[0] > 0) {
+		return track_add_straight(t, v[0]);
+	}
+	if ((!strcmp(op, "left") || !strcmp(op, "right")) && n == 2 && v[0] > 0 && v[1] > 0) {
+		return track_add_arc(t, v[0], track_side(op) * v[1] * TRACK_DEG);
+	}
+	if (!strcmp(op, "crank") && side && n == 0) {
+		return track_add_corner(t, side * M_PI / 2);
+	}
+	if (!strcmp(op, "crossline") && l->n == 1) {
+		return track_add_mark(t, TRACK_MARK_CROSS);
+	}
+	if (!strcmp(op, "halfline") && side && n == 0) {
+		return track_add_mark(t, side > 0 ? TRACK_MARK_HALF_LEFT : TRACK_MARK_HALF_RIGHT);
+	}
+	if (!strcmp(op, "lanechange") && side) {
+		if (n < 1) {
+			v[0] = TRACK_LANE_OFFSET;
+		}
+		if (n < 2) {
+			v[1] = TRACK_LANE_LENGTH;
+		}
+		if (v[0] > 0 && v[1] > 0) {
+			return track_add_lane_change(t, side * v[0], v[1]);
+		}
+	}
+
+	snprintf(err, err_size, "bad element '%s'", op);
+	return -1;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Compile a track description held in memory                     */
+/* Return values:                                                      */
+/*		0: ok, -1: error, message "line N: ..." in err                 */
+/***********************************************************************/
+int track_parse(struct track *t, const char *text, char *err, int err_size)
+{
+	char line[TRACK_MAX_LINE];
+	char msg[TRACK_MAX_LINE];
+	struct track_line l;
+	const char *p = text, *eol;
+	int lineno = 0;
+	size_t len;
+
+	track_init(t);
+
+	while (*p) {
+		lineno++;
+		eol = strchr(p, '\n');
+		len = eol ? (size_t)(eol - p) : strlen(p);
+		if (len >= sizeof(line)) {
+			snprintf(err, err_size, "line %d: too long", lineno);
+			track_free(t);
+			return -1;
+		}
+		memcpy(line, p, len);
+		line[len] = '\0';
+		p += len + (eol ? 1 : 0);
+
+		track_split(line, &l);
+		if (!l.n) {
+			continue;
+		}
+		if (track_element(t, &l, msg, sizeof(msg))) {
+			snprintf(err, err_size, "line %d: %s", lineno, msg);
+			track_free(t);
+			return -1;
+		}
+	}
+
+	if (!t->count) {
+		snprintf(err, err_size, "empty track");
+		return -1;
+	}
+	track_finish(t);
+	return 0;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Compile a track file                                           */
+/***********************************************************************/
+int track_load(struct track *t, const char *path, char *err, int err_size)
+{
+	FILE *f;
+	char *text;
+	long size;
+	int ret;
+
+	track_init(t);
+
+	f = fopen(path, "rb");
+	if (!f) {
+		snprintf(err, err_size, "%s: cannot open", path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	text = malloc(size + 1);
+	if (!text || fread(text, 1, size, f) != (size_t)size) {
+		snprintf(err, err_size, "%s: read error", path);
+		free(text);
+		fclose(f);
+		return -1;
+	}
+	text[size] = '\0';
+	fclose(f);
+
+	ret = track_parse(t, text, err, err_size);
+	free(text);
+	return ret;
+}
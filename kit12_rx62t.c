@@ -18,7 +18,7 @@ This program supports the following boards:
 * T =0,155m (Tread) (vorder abstand != hintere Abstand)
 *
 * Notation rules:
-*  /* For comments about a block 
+*  / * For comments about a block
 * // For comments about one line/ parameterdescriptions
 **/
 
@@ -27,19 +27,93 @@ This program supports the following boards:
 /*======================================*/
 /* Include                              */
 /*======================================*/
-#include "iodefine.h"
+#include <stddef.h>
+
+#include "actuator.h"
+#include "control.h"
+#include "fixed.h"
+#include "hal.h"
+#include "odometry.h"
+#include "table.h"
+#include "tuning.h"
 
 /*======================================*/
 /* Symbol definitions                   */
 /*======================================*/
 
 /* Constant settings */
-#define PWM_CYCLE       24575           // Motor PWM period (16ms)     
+/* Servo profile: 1 digital servo (3ms frame), 0 analog servo (16ms frame) */
+#define SERVO_DIGITAL	1
+#if SERVO_DIGITAL
+#define SERVO_FRAME_US	3000			// a new angle reaches the servo within one frame
+#define SERVO_SLEW		500				// degrees per second the servo turns
+#else
+#define SERVO_FRAME_US	16000
+#define SERVO_SLEW		400
+#endif
+#define PWM_CYCLE		((unsigned short)(HAL_SERVO_HZ / 1000 * SERVO_FRAME_US / 1000 - 1))	// Servo PWM period
+#define MOTOR_PWM_CYCLE	3071			// Motor PWM period (250us, 4kHz)
 #define SERVO_CENTER    2038            // Servo center value NR 2 2038 
 #define HANDLE_STEP     13              // 1 degree value              
 #define MAXIMUM_ANGLE	45				        // This is the maximum angle for NR 2 
+#define WHEELBASE		0.143			// m, W of Car NR 2
+#define TREAD			0.155			// m, T of Car NR 2 (rear)
 #define CURVE_ENTRANCE_MOTOR_POWER	10	// motor power for smoothly driving through the 90° curve 
-#define TIME_FOR_SLOW_DOWN_CURVE	300	  // time span in which the car should slow down from the actual motor power to the CURVE_ENTRANCE_MOTOR_POWER 
+#define CONTROL_PERIOD_MS	1			// one control step every CMT0 interrupt
+#define HIRES_PER_MS		(HAL_HIRES_HZ / 1000)	// timestamp() counts
+
+/* Wheel speed control, motor() sets target speeds. 0: motor() sets the duty directly */
+#define SPEED_CONTROL		1
+#define SPEED_PER_POWER		FX(0.032)		// m/s per motor() percent, 3.2 m/s at 100
+#define SPEED_FEEDFORWARD	FX(31.25)		// duty percent per m/s, 1 / SPEED_PER_POWER
+#define SPEED_KP			FX(30)			// duty percent per m/s of error
+#define SPEED_KI_DT			FX(0.1)			// KI 100 %/(m/s s) times the 1ms period
+#define SPEED_STOP_BAND		FX(0.05)		// m/s, target 0 and slower: motor off
+
+/* Crank maneuvers by encoder travel, not time: right at any speed.
+ * The search and turn travel may be set with -D on the host */
+#define CROSSLINE_BLANK_MM	30				// past the 2nd cross line before crank detection
+#ifndef CRANK_SEARCH_MM
+#define CRANK_SEARCH_MM		1000			// no crank this far after the 2nd cross line: trace on
+#endif
+#ifndef CRANK_TURN_MM
+#define CRANK_TURN_MM		90				// full lock after the crank is seen, then look for the line
+#endif
+
+/* Crank entry braking: one reverse duty pulse from the 1st cross line
+ * down to the approach speed, harder the faster the car comes in.
+ * The approach power and the duty range may be set with -D on the host */
+#ifndef CRANK_APPROACH_POWER
+#define CRANK_APPROACH_POWER	30			// motor() power from the cross line to the crank
+#endif
+#define MOTOR_TAU_MS		120				// wheel speed time constant after a duty step
+#define BRAKE_SPEEDS		16				// brakeTable entry and target speeds
+#define BRAKE_SPEED_STEP	0.25			// m/s between two of them
+#ifndef BRAKE_POWER_MIN
+#define BRAKE_POWER_MIN		30				// reverse duty percent entering at 0 m/s
+#endif
+#ifndef BRAKE_POWER_MAX
+#define BRAKE_POWER_MAX		100				// entering at the top speed
+#endif
+
+/* Lane change: open loop S curve planned from the speed where the line
+ * ends, at the straight line power, then back to the normal trace */
+#define LANE_OFFSET_MM		250				// lane center to lane center, track specification
+#define LANE_ACCEL			6				// m/s^2, lateral acceleration of the S curve arcs
+#define LANE_ANGLE_MAX		30				// handle() of the arcs at low speed
+#define LANE_RUN_MM			1000			// longest S curve: faster, brake first
+
+/* Normal trace steering: LINE_PD in tuning.h */
+#define LINE_LOST_MM		75				// line offset assumed when no sensor sees it
+#define LINE_RATE_HOLD_MS	100				// offset rate kept this long after a transition
+
+/* Analog line sensors (S12AD0/S12AD1 + DTC). 1: line_update() uses their
+ * intensity centroid while it sees the line, 0: not scanned at all */
+#define SENSOR_ANALOG		1
+#define ANALOG_WHITE		1000			// raw level assumed on the line until one is seen
+#define ANALOG_BLACK		3000			// raw level assumed on the floor until one is seen
+#define ANALOG_LINE			500				// intensity sum (per mille) that counts as line seen
+#define LINE_RATE_FILTER	8				// analog offset rate: low pass over about 8 steps
 
 /* Masked value settings X:masked (disabled) O:not masked (enabled)Maske bedeutet welche Sensorn überhaupt abgefragt werden */
 #define MASK2_2         0x66            /* X O O X  X O O X            */
@@ -62,11 +136,31 @@ This program supports the following boards:
 #define MASK1_1_Middle		0x42			/* X 0 X X  X X 0 X				*/
 #define MASK1_1_Outer		0x81			/* 0 X X X  X X X 0				*/
 
+/* Software timers, see timer_start() */
+enum timer_id {
+	TIMER_CONTROL,		// control loop period, periodic
+	TIMER_STATE,		// time in the current pattern, restarted by state_step()
+	TIMER_DELAY,		// timer()
+	TIMER_BRAKE,		// brake pulse, see brake_start()
+	TIMERS
+};
+
+enum travel_id {
+	TRAVEL_STATE,		// travel in the current pattern, restarted by state_step()
+	TRAVEL_CROSSLINE,	// travel since the 2nd cross line
+	TRAVELS
+};
+
 /*======================================*/
 /* Prototype declarations               */
 /*======================================*/
 void init(void);
 void timer(unsigned long timer_set);
+void sensor_sample(void);
+void analog_update(void);
+void line_update(void);
+int steer_pd(void);
+void odometry_update(void);
 unsigned char sensor_inp(unsigned char mask);
 unsigned char startbar_get(void);
 int check_crossline(void);
@@ -79,31 +173,450 @@ unsigned char pushsw_get(void);
 void led_out_m(unsigned char led);
 void led_out(unsigned char led);
 void motor(int accele_l, int accele_r);
+void motor_output(int wheel, int power);
+void speed_control(void);
 void handle(int angle);
-void slowDownMotorPower_linear(int time);
+void actuator_commit(void);
+void actuator_apply(void);
+void drive(int angle, int power);
+void trace(enum trace_row row);
+void brake_start(fx_t entry, fx_t target);
+void brake_update(void);
+void state_step(void);
+void control_wait(void);
+void control_done(void);
+void clock_read(unsigned long *ms, unsigned short *count);
+void crossline_capture(unsigned char sensor, unsigned long now);
+unsigned long timestamp(void);
+unsigned long timestamp_us(unsigned long counts);
+void timer_start(enum timer_id id, unsigned long period, unsigned char periodic);
+unsigned long timer_elapsed(enum timer_id id);
+int timer_expired(enum timer_id id);
+void travel_start(enum travel_id id);
+long travel_elapsed(enum travel_id id);
+void flash_leds(unsigned long period);
+void lane_trace(void);
+void lane_plan(int side);
+unsigned char lane_follow(void);
+unsigned long isqrt(unsigned long n);
+unsigned char state_0_tick(void);
+unsigned char state_1_tick(void);
+unsigned char state_11_tick(void);
+unsigned char state_12_tick(void);
+unsigned char state_13_tick(void);
+void state_21_entry(void);
+unsigned char state_22_tick(void);
+unsigned char state_221_tick(void);
+unsigned char state_222_tick(void);
+unsigned char state_23_tick(void);
+unsigned char state_31_tick(void);
+unsigned char state_41_tick(void);
+unsigned char state_32_tick(void);
+unsigned char state_42_tick(void);
+void state_51_entry(void);
+unsigned char state_52_tick(void);
+void state_53_entry(void);
+unsigned char state_53_tick(void);
+unsigned char state_54_tick(void);
+void state_61_entry(void);
+unsigned char state_62_tick(void);
+unsigned char state_63_tick(void);
+unsigned char state_64_tick(void);
 
 /*======================================*/
 /* Global variable declarations         */
 /*======================================*/
 //speedFactor ignores DIP Settings in motor()
-//Maximum is 0,7 for secure driving, due to hardware limits
-double speedFactor = 0.7;
+//Maximum is 0,7 for secure driving, due to hardware limits, Q16.16 (fixed.h)
+HAL_STATE fx_t speedFactor = FX_RATIO(7, 10);
 
-//Current Speed of car in m/s
+//Current Speed of car in m/s, Q16.16 (fixed.h)
 // 2 m/s ist so das maximum was der wagen auf mindesetns 1,5 m beschleunigen kann
-double measuredSpeed=1.4;
+HAL_STATE fx_t measuredSpeed = FX_RATIO(14, 10);
 
 //Distance beetwen Beginning of First Crossline to End of secound Crossline in mm
 //Programm Explantion Manual Page 125
-double gapDistance = 90;
-
-//Testtimer
-int crankTimer=100;
+HAL_STATE int gapDistance = 90;
+
+//timestamp() at the 1st crossline, speed measurement
+HAL_STATE unsigned long crosslineStamp;
+
+/* Double cross line edges, timestamped by the CMT1 sample interrupt so
+ * the gap time does not depend on when the main loop gets to see them */
+enum crossline_phase {
+	CAPTURE_IDLE,		// no cross line
+	CAPTURE_LINE1,		// on the 1st cross line, start captured
+	CAPTURE_GAP,		// between the lines
+	CAPTURE_LINE2,		// on the 2nd cross line
+	CAPTURE_DONE		// end captured
+};
+struct crossline_capture {
+	unsigned char phase;				// enum crossline_phase
+	unsigned long start;				// timestamp(), 1st line entered
+	unsigned long end;					// timestamp(), 2nd line left
+};
+#define CAPTURE_TIMEOUT	(HIRES_PER_MS * 200)	// line to line at 0.5m/s
+HAL_STATE volatile struct crossline_capture crosslineCapture;
+
+/* Monotonic time, only the CMT0 interrupt writes it. A 32 bit read is
+ * one instruction on the RX, so reading it needs no interrupt lock. */
+HAL_STATE volatile unsigned long msTicks;	// free running, 1ms
+HAL_STATE volatile unsigned long hiresWraps;	// CMT2 wraps, see timestamp()
+
+/* Software timers. A timer is just its start time, the interrupt only
+ * advances msTicks: starting, reading and expiry are O(1) whatever the
+ * number of timers, and no maneuver resets another one's counter. */
+struct soft_timer {
+	unsigned long start;				// msTicks when (re)started
+	unsigned long period;				// ms, 0: stopwatch, never expires
+	unsigned char periodic;				// restart by itself on expiry
+};
+HAL_STATE struct soft_timer timers[TIMERS];
+
+/* Travel marks, the distance counterpart of the software timers: a
+ * mark is just odometry.travel_mm when it was (re)started */
+HAL_STATE long travelMarks[TRAVELS];
+
+/* Fixed rate control loop, see control.h */
+HAL_STATE struct control_stats controlStats;
+HAL_STATE unsigned long controlStart;	// timestamp() of the running step
+
+/* Sensor frame all decisions of one main loop pass are based on */
+struct sensor_frame {
+	unsigned char sensor;				// line sensors, 1: line detected
+	unsigned char code;					// sensorClass[sensor]
+	unsigned long time;					// msTicks when sampled
+};
+HAL_STATE struct sensor_frame sensorFrame;
+
+/* Analog line sensors, see analog_update(). Calibration: lowest and
+ * highest raw level every sensor has seen, starting from ANALOG_WHITE
+ * and ANALOG_BLACK */
+struct sensor_analog {
+	unsigned short raw[HAL_ANALOG_CHANNELS];	// bit order of sensorFrame.sensor
+	unsigned short white[HAL_ANALOG_CHANNELS];	// on the line
+	unsigned short black[HAL_ANALOG_CHANNELS];	// on the floor
+	unsigned short level[HAL_ANALOG_CHANNELS];	// per mille, 1000: on the line
+	fx_t position;						// mm, intensity centroid, positive left
+	unsigned char valid;				// a scan sees the line
+};
+HAL_STATE struct sensor_analog sensorAnalog;
+
+/* DTC vector table and scan ring, first in RAM for the 4 KB alignment */
+#pragma section B DTC
+HAL_STATE struct hal_analog analogScan;
+#pragma section
+
+/* Line position estimate, see line_update() */
+struct line_estimate {
+	fx_t raw;							// mm, centroid of the current frame
+	fx_t boundary;						// mm, where the last transition happened
+	fx_t offset;						// mm, estimate, positive left
+	fx_t rate;							// mm/s, from the last two transitions
+	unsigned long changed;				// msTicks of the last transition
+};
+HAL_STATE struct line_estimate lineEstimate;
+HAL_STATE enum trace_row traceRow = TRACE_00;	// last row with a reaction
+
+/* Wheel encoders, see odometry.h */
+struct odometry_sample {
+	long counts[WHEELS];
+	unsigned long time;					// timestamp()
+};
+HAL_STATE struct odometry odometry;
+HAL_STATE unsigned short odometryRaw[WHEELS];	// last MTU1/MTU2 TCNT
+HAL_STATE struct odometry_sample odometryHistory[ODOMETRY_WINDOW];
+HAL_STATE unsigned char odometryIndex;		// oldest odometryHistory entry
+
+/* Per wheel PI speed controller, see speed_control() */
+struct speed_pi {
+	fx_t target;						// m/s, set by motor()
+	fx_t integral;						// duty percent
+	int power;							// duty percent, last output
+};
+HAL_STATE struct speed_pi speedPi[WHEELS];
+
+/* Reverse duty pulse, see brake_start(). While it runs speed_control()
+ * (or motor() without SPEED_CONTROL) leaves the motors to it. */
+struct brake {
+	unsigned char active;
+	signed char power;					// both wheels, negative
+	unsigned short ms;					// pulse length, TIMER_BRAKE
+	fx_t target;						// m/s, the pulse ends here at the latest
+	signed char resume[WHEELS];			// last motor() power, without SPEED_CONTROL
+};
+HAL_STATE struct brake brake;
+
+/* Lane change S curve, see lane_plan(). By TRAVEL_STATE from the end of
+ * the line: angle up to switch_mm, -angle up to end_mm, then straight. */
+struct lane_plan {
+	signed char angle;					// handle() of the first arc, positive right
+	int power;							// drive() power
+	long switch_mm;						// to the second arc
+	long end_mm;						// to straight
+};
+HAL_STATE struct lane_plan lanePlan;
+
+/* Actuator commands, see actuator.h. Only the GPT1 period interrupt
+ * reads actuatorReady, and only while actuatorPending is set. */
+HAL_STATE struct actuator_cmd actuatorNext = { { 0, 0 }, 0, SERVO_CENTER };	// being built
+HAL_STATE struct actuator_cmd actuatorReady;		// complete, not yet put out
+HAL_STATE volatile unsigned char actuatorPending;
+HAL_STATE unsigned char actuatorReverse;			// for the duties in the GTCCRA now
+HAL_STATE struct actuator_stats actuatorStats;
+HAL_STATE int pattern;
+HAL_STATE int statePattern = -1;		// pattern whose entry action ran
+HAL_STATE int actualMotorPower = 100;	// important for 90° curve 
+
+/* PD steering gains per m/s, see tuning.h */
+HAL_TUNABLE struct steer_gain steerGain[STEER_GAIN_ROWS] = {
+	/*   kp           kd */
+	{ FX(1.73),  FX(0.0068) },	// 0 m/s
+	{ FX(1.68),  FX(0.0039) },	// 1 m/s
+	{ FX(0.95),  FX(0.0039) },	// 2 m/s
+	{ FX(0.17),  FX(0.0026) },	// 3 m/s
+};
+
+/* Normal trace reaction per sensor pattern, see tuning.h */
+HAL_TUNABLE struct trace_step traceTable[TRACE_ROWS] = {
+	/* angle  power */
+	{   0,  100 },	// TRACE_00
+	{  15,   80 },	// TRACE_04 Default 15
+	{  40,   60 },	// TRACE_06 Default 30, was motor(60, 40)
+	{  55,   25 },	// TRACE_07 Default 45, was motor(25, 15)
+	{  60,    7 },	// TRACE_03 was motor(7.5, 4.75)
+	{ -15,   80 },	// TRACE_20
+	{ -40,   60 },	// TRACE_60 was motor(40, 60)
+	{ -55,   25 },	// TRACE_E0 was motor(15, 25)
+	{ -60,    7 },	// TRACE_C0 was motor(4.75, 7.5)
+	{ -80,    7 },	// TRACE_01 was motor(4, 7)
+};
+
+/* Actuator counts, generated from the constant settings (table.h) */
+struct motor_pwm {
+	unsigned short duty;	// GPT1/GPT2 GTCCRC count
+	unsigned char reverse;	// direction signal
+};
+
+#define MOTOR_POWER_MAX	100
+#define MOTOR_PWM(p)	{ (unsigned short)((long)(MOTOR_PWM_CYCLE - 1) * ((p) < 0 ? -(p) : (p)) / 100), (p) < 0 }
+#define SERVO_PWM(a)	((unsigned short)(SERVO_CENTER - (a) * HANDLE_STEP))
+
+// motor(): -100 to 100
+const struct motor_pwm motorPwm[2 * MOTOR_POWER_MAX + 1] = {
+	TABLE_201(MOTOR_PWM, -MOTOR_POWER_MAX)
+};
+
+// handle(): -MAXIMUM_ANGLE to MAXIMUM_ANGLE
+// When the servo move from left to right in reverse, replace "-" with "+" in SERVO_PWM.
+const unsigned short servoPwm[2 * MAXIMUM_ANGLE + 1] = {
+	TABLE_91(SERVO_PWM, -MAXIMUM_ANGLE)
+};
+
+/* Electronic differential: outer and inner rear wheel speed relative to
+ * the rear axle center for every handle() angle. The center runs on a
+ * circle of W / tan(a), the wheels T / 2 outside and inside of it. tan()
+ * as its Taylor series up to x^9 (0.1% low at 45 degrees) so the table
+ * is a constant. */
+#define DIFF_RAD(a)		((double)((a) < 0 ? -(a) : (a)) * 3.14159265358979 / 180)
+#define DIFF_TAN2(x2)	(1 + (x2) * (1.0 / 3 + (x2) * (2.0 / 15 + (x2) * (17.0 / 315 + (x2) * 62.0 / 2835))))
+#define DIFF_TAN(x)		((x) * DIFF_TAN2((x) * (x)))
+#define DIFF_K(a)		(TREAD / (2 * WHEELBASE) * DIFF_TAN(DIFF_RAD(a)))
+#define DIFF_WHEELS(a)	{ FX(1 + DIFF_K(a)), FX(1 - DIFF_K(a)) }
+
+struct diff_wheels {
+	fx_t outer;
+	fx_t inner;
+};
+
+// drive(): -MAXIMUM_ANGLE to MAXIMUM_ANGLE
+const struct diff_wheels diffWheels[2 * MAXIMUM_ANGLE + 1] = {
+	TABLE_91(DIFF_WHEELS, -MAXIMUM_ANGLE)
+};
+
+/* Crank entry braking profiles for every entry and target speed,
+ * BRAKE_SPEED_STEP apart: index entry * BRAKE_SPEEDS + target. A reverse
+ * duty d drives the wheel speed v toward -d * V100 with MOTOR_TAU_MS, so
+ * it takes tau * ln((ve + d V100) / (vt + d V100)) to get from ve to vt.
+ * ln() as 2 atanh((x - 1) / (x + 1)), series up to y^7 (below 0.01% for
+ * the ratios here) so the table is a constant. */
+#define BRAKE_POWER(e)	(BRAKE_POWER_MIN + (BRAKE_POWER_MAX - BRAKE_POWER_MIN) * (e) / (BRAKE_SPEEDS - 1))
+#define BRAKE_VD(e)		(BRAKE_POWER(e) * (double)SPEED_PER_POWER / FX_ONE)
+#define BRAKE_Y(x)		(((x) - 1) / ((x) + 1))
+#define BRAKE_LN2(y)	(2 * (y) * (1 + (y) * (y) * (1.0 / 3 + (y) * (y) * (1.0 / 5 + (y) * (y) / 7))))
+#define BRAKE_LN(x)		BRAKE_LN2(BRAKE_Y(x))
+#define BRAKE_RATIO(e, t)	(((e) * BRAKE_SPEED_STEP + BRAKE_VD(e)) / ((t) * BRAKE_SPEED_STEP + BRAKE_VD(e)))
+#define BRAKE_CELL(e, t)	{ (t) < (e) ? -BRAKE_POWER(e) : 0, \
+							  (t) < (e) ? (unsigned short)(MOTOR_TAU_MS * BRAKE_LN(BRAKE_RATIO(e, t)) + 0.5) : 0 }
+#define BRAKE_STEP(i)	BRAKE_CELL((i) / BRAKE_SPEEDS, (i) % BRAKE_SPEEDS)
+
+struct brake_step {
+	signed char power;		// reverse duty percent, 0: no braking
+	unsigned short ms;		// pulse length
+};
+
+// brake_start(): entry speed row, target speed column
+const struct brake_step brakeTable[BRAKE_SPEEDS * BRAKE_SPEEDS] = {
+	TABLE_256(BRAKE_STEP, 0)
+};
+
+// TABLE_256 has to match BRAKE_SPEEDS, compile error otherwise
+typedef char brakeTable_size_check[(BRAKE_SPEEDS * BRAKE_SPEEDS == 256) ? 1 : -1];
+
+/* Lane change arc radius for handle() angles 1 to 32: the rear axle
+ * center circle W / tan(a), in mm */
+#define LANE_RADIUS(a)	((unsigned short)(WHEELBASE * 1000 / DIFF_TAN(DIFF_RAD(a)) + 0.5))
+
+// lane_plan(): index angle - 1
+const unsigned short laneRadius[32] = {
+	TABLE_32(LANE_RADIUS, 1)
+};
+
+// laneRadius has to cover LANE_ANGLE_MAX, compile error otherwise
+typedef char laneRadius_size_check[(LANE_ANGLE_MAX >= 1 && LANE_ANGLE_MAX <= 32) ? 1 : -1];
+
+// TABLE_91 has to match MAXIMUM_ANGLE, compile error otherwise
+typedef char servoPwm_size_check[(2 * MAXIMUM_ANGLE + 1 == 91) ? 1 : -1];
+
+/* Sensor frame classification: event in the high nibble, traceTable row
+ * in the low nibble (TRACE_ROWS: no reaction). Generated with the same
+ * masks as check_crossline(), check_rightline(), check_leftline() and the
+ * MASK3_3 switch of pattern 11, highest priority first. */
+#define SENSOR_NONE			0x00
+#define SENSOR_CROSSLINE	0x10
+#define SENSOR_RIGHTLINE	0x20
+#define SENSOR_LEFTLINE		0x30
+#define SENSOR_LOST			0x40			// no sensor sees the line
+#define SENSOR_EVENT(c)		((c) & 0xf0)
+#define SENSOR_EVENT_INDEX(c)	((c) >> 4)
+#define SENSOR_EVENTS		5
+#define SENSOR_ROW(c)		((enum trace_row)((c) & 0x0f))
+
+#define SENSOR_EVENT_OF(s)	((((s) & MASK4_4) == 0xff || ((s) & MASK4_4) == 0x7e || \
+							  ((s) & MASK4_4) == 0x3c) ? SENSOR_CROSSLINE : \
+							 ((s) & MASK4_4) == 0x1f ? SENSOR_RIGHTLINE : \
+							 ((s) & MASK4_4) == 0xf8 ? SENSOR_LEFTLINE : \
+							 (s) == 0x00 ? SENSOR_LOST : SENSOR_NONE)
+#define SENSOR_ROW_OF(s)	(((s) & MASK3_3) == 0x00 ? TRACE_00 : ((s) & MASK3_3) == 0x04 ? TRACE_04 : \
+							 ((s) & MASK3_3) == 0x06 ? TRACE_06 : ((s) & MASK3_3) == 0x07 ? TRACE_07 : \
+							 ((s) & MASK3_3) == 0x03 ? TRACE_03 : ((s) & MASK3_3) == 0x20 ? TRACE_20 : \
+							 ((s) & MASK3_3) == 0x60 ? TRACE_60 : ((s) & MASK3_3) == 0xe0 ? TRACE_E0 : \
+							 ((s) & MASK3_3) == 0xc0 ? TRACE_C0 : ((s) & MASK3_3) == 0x01 ? TRACE_01 : \
+							 TRACE_ROWS)
+#define SENSOR_CLASS(s)		((unsigned char)(SENSOR_EVENT_OF(s) | SENSOR_ROW_OF(s)))
+
+const unsigned char sensorClass[256] = {
+	TABLE_256(SENSOR_CLASS, 0)
+};
+
+/* Line position under the sensor row per frame, mm, positive left: the
+ * centroid of the sensors that see the line (Sensor board Ver. 5
+ * spacing). 0 for the empty frame, line_update() handles that. */
+#define LINE_Y(s, b)	(((s) >> (b) & 1) * ((b) == 7 ? 60 : (b) == 6 ? 40 : (b) == 5 ? 22 : (b) == 4 ? 7 : \
+										 (b) == 3 ? -7 : (b) == 2 ? -22 : (b) == 1 ? -40 : -60))
+#define LINE_SUM(s)		(LINE_Y(s, 0) + LINE_Y(s, 1) + LINE_Y(s, 2) + LINE_Y(s, 3) + \
+						 LINE_Y(s, 4) + LINE_Y(s, 5) + LINE_Y(s, 6) + LINE_Y(s, 7))
+#define LINE_BITS(s)	(((s) & 1) + ((s) >> 1 & 1) + ((s) >> 2 & 1) + ((s) >> 3 & 1) + \
+						 ((s) >> 4 & 1) + ((s) >> 5 & 1) + ((s) >> 6 & 1) + ((s) >> 7 & 1))
+#define LINE_POS(s)		((s) == 0 ? 0 : FX((double)LINE_SUM(s) / ((s) == 0 ? 1 : LINE_BITS(s))))
+
+const fx_t linePos[256] = {
+	TABLE_256(LINE_POS, 0)
+};
+
+/* Position of every sensor, mm, bit order */
+#define SENSOR_Y(b)		FX(LINE_Y(0xff, b))
+
+const fx_t sensorY[HAL_ANALOG_CHANNELS] = {
+	TABLE_8(SENSOR_Y, 0)
+};
 
-unsigned long cnt0;
-unsigned long cnt1;			// Timer
-int pattern;
-int actualMotorPower = 100;	// important for 90° curve 
+/*======================================*/
+/* State machine                        */
+/*======================================*/
+/****************************************************************
+Pattern-related
+ 0: wait for switch input
+ 1: check if start bar is open
+11: normal trace
+12: check end of large turn to right
+13: check end of large turn to left
+21: processing at 1st cross line
+22: read but ignore 2nd time
+220: check second crossline
+221: check normal line after the crosslines
+222: short break to avoid wrong detection
+23: trace, crank detection after cross line
+31: left crank clearing processing ? wait until stable
+32: left crank clearing processing ? check end of turn
+41: right crank clearing processing ? wait until stable
+42: right crank clearing processing ? check end of turn
+51: processing at 1st right half line detection
+52: read but ignore 2nd line
+53: trace after right half line detection
+54: right lane change end check
+61: processing at 1st left half line detection
+62: read but ignore 2nd line
+63: trace after left half line detection
+64: left lane change end check
+****************************************************************/
+
+/* Transition target meaning "no transition". Pattern 0 is only entered
+ * at power on or from an unknown pattern, never by a transition. */
+#define STAY			0
+#define PATTERN_MAX		222
+
+struct state {
+	const char *name;
+	void (*entry)(void);				// first pass in the state, TIMER_STATE restarted
+	unsigned char (*tick)(void);		// every pass, next pattern or STAY
+	unsigned char on_event[SENSOR_EVENTS];	// next pattern per sensorFrame event
+	unsigned short timeout;				// ms in the state (TIMER_STATE), 0: none
+	unsigned char on_timeout;
+	unsigned char next;					// after the first pass
+};
+
+/* 0: stop after the cross line (speed measurement test).
+ * host/Makefile builds the crank variant with -DCRANK_DETECTION=1 */
+#ifndef CRANK_DETECTION
+#define CRANK_DETECTION	0
+#endif
+
+/*                               name                     entry            tick              none cros rght left lost    tmo to  nxt */
+const struct state state_0   = { "wait for switch",       NULL,            state_0_tick,    {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_1   = { "wait for start bar",    NULL,            state_1_tick,    {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_11  = { "normal trace",          NULL,            state_11_tick,   {   0,  21,  51,  61,   0 },   0,  0,  0 };
+const struct state state_12  = { "large turn right",      NULL,            state_12_tick,   {   0,  21,  51,  61,   0 },   0,  0,  0 };
+const struct state state_13  = { "large turn left",       NULL,            state_13_tick,   {   0,  21,  51,  61,   0 },   0,  0,  0 };
+const struct state state_21  = { "1st cross line",        state_21_entry,  NULL,            {   0,   0,   0,   0,   0 },   0,  0, 22 };
+const struct state state_22  = { "cross line",            NULL,            state_22_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_220 = { "cross line gap",        NULL,            NULL,            {   0, 221,   0,   0,   0 },   0,  0,  0 };
+const struct state state_221 = { "2nd cross line",        NULL,            state_221_tick,  {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_222 = { "after cross line",      NULL,            state_222_tick,  {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_23  = { "crank detection",       NULL,            state_23_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_31  = { "left crank",            NULL,            state_31_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_32  = { "left crank end",        NULL,            state_32_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_41  = { "right crank",           NULL,            state_41_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_42  = { "right crank end",       NULL,            state_42_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_51  = { "1st right half line",   state_51_entry,  NULL,            {   0,   0,   0,   0,   0 },   0,  0, 52 };
+const struct state state_52  = { "right half line",       NULL,            state_52_tick,   {   0,   0,   0,   0,   0 }, 100, 53,  0 };
+const struct state state_53  = { "right lane change",     state_53_entry,  state_53_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_54  = { "right lane change end", NULL,            state_54_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_61  = { "1st left half line",    state_61_entry,  NULL,            {   0,   0,   0,   0,   0 },   0,  0, 62 };
+const struct state state_62  = { "left half line",        NULL,            state_62_tick,   {   0,   0,   0,   0,   0 }, 100, 63,  0 };
+const struct state state_63  = { "left lane change",      NULL,            state_63_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+const struct state state_64  = { "left lane change end",  NULL,            state_64_tick,   {   0,   0,   0,   0,   0 },   0,  0,  0 };
+
+/* Indexed by pattern, NULL: unknown pattern */
+const struct state *const states[PATTERN_MAX + 1] = {
+	[0] = &state_0,		[1] = &state_1,
+	[11] = &state_11,	[12] = &state_12,	[13] = &state_13,
+	[21] = &state_21,	[22] = &state_22,	[220] = &state_220,	[221] = &state_221,	[222] = &state_222,
+	[23] = &state_23,
+	[31] = &state_31,	[32] = &state_32,	[41] = &state_41,	[42] = &state_42,
+	[51] = &state_51,	[52] = &state_52,	[53] = &state_53,	[54] = &state_54,
+	[61] = &state_61,	[62] = &state_62,	[63] = &state_63,	[64] = &state_64,
+};
 
 /***********************************************************************/
 /* Main program                                                        */
@@ -116,654 +629,500 @@ void main(void)
 	/* Initialize micom car state */
 	handle(0);
 	motor(0, 0);
+	actuator_commit();
 
 	while (1) {
-		switch (pattern) {
-
-			/****************************************************************
-			Pattern-related
-			 0: wait for switch input
-			 1: check if start bar is open
-			11: normal trace
-			12: check end of large turn to right
-			13: check end of large turn to left
-			21: processing at 1st cross line
-			22: read but ignore 2nd time
-			220: check second crossline
-			221: check normal line after the crosslines
-			222: short break to avoid wrong detection	
-			23: trace, crank detection after cross line
-			31: left crank clearing processing ? wait until stable
-			32: left crank clearing processing ? check end of turn
-			41: right crank clearing processing ? wait until stable
-			42: right crank clearing processing ? check end of turn
-			51: processing at 1st right half line detection
-			52: read but ignore 2nd line
-			53: trace after right half line detection
-			54: right lane change end check
-			61: processing at 1st left half line detection
-			62: read but ignore 2nd line
-			63: trace after left half line detection
-			64: left lane change end check
-			****************************************************************/
-
-		case 0:
-
-			/* Wait for switch input */
-			if (pushsw_get()) {
-				pattern = 1;
-				cnt1 = 0;
-				break;
-			}
-
-			/* LED flashing processing     */
-			if (cnt1 < 100) {          
-				led_out(0x1);
-			}
-			else if (cnt1 < 200) {
-				led_out(0x2);
-			}
-			else {
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 1:
-
-			/* Check if start bar is open */
-			if (!startbar_get()) {
-				/* Start!! */
-				led_out(0x0);
-				pattern = 11;
-				cnt1 = 0;
-				break;
-			}
-
-			/* LED flashing processing     */
-			if (cnt1 < 50) {         
-				led_out(0x1);
-			}
-			else if (cnt1 < 100) {
-				led_out(0x2);
-			}
-			else {
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 11:
-			/* Normal trace */
-
-			/* Cross line check */
-			if (check_crossline()) {   
-				pattern = 21;
-				break;
-			}
-
-			/* Right half line detection check */
-			if (check_rightline()) {   
-				pattern = 51;
-				while(1){
-					motor(0,0);
-
-					if (cnt1 < 50) {           /* LED flashing processing     */
-								led_out(0x1);
-							}
-							else if (cnt1 < 100) {
-								led_out(0x2);
-							}
-							else {
-								cnt1 = 0;
-							}
-				}
-				break;
-			}
-
-			 /* Left half line detection check */
-			if (check_leftline()) {  
-				pattern = 61;
-				break;
-
-			}
-
-		//	if(check_not_on_track()){  // break if not on track
-		//		motor(0,0);
-		//		break;
-		//	}
-
-
-			switch (sensor_inp(MASK3_3)) {
-
-			case 0x00:
-				/* Center -> straight */
-				handle(0);
-				motor(100, 100);
-				led_out(0x01);
-				break;
-
-				//Right Turn
-			case 0x04:
-				/* Slight amount left of center -> slight turn to right */
-				handle(15);		//Default 15
-				motor(80, 80);
-				break;
-
-			case 0x06:
-				/* Small amount left of center -> small turn to right */
-				handle(40);		//Default 30
-				motor(60, 40);	// Default 20, 16,75
-				break;
-
-			case 0x07:
-				/* Medium amount left of center -> medium turn to right */			
-				handle(55);		//Default 45
-				motor(25, 15);	//Default 12,5 9,5
-				pattern = 12;
-				break;
-
-			case 0x03:
-				/* Large amount left of center -> large turn to right */
-				handle(60);
-				motor(7.5, 4.75);
-				break;
-
-			case 0x20:
-				/* Slight amount right of center -> slight turn to left */
-				handle(-15);
-				motor(80, 80);
-				led_out(0x02);
-				break;
-
-			case 0x60:
-				/* Small amount right of center -> small turn to left */
-				handle(-40);
-				motor(40, 60);
-				break;
-
-			case 0xe0:
-				/* Medium amount right of center -> medium turn to left */
-				handle(-55);
-				motor(15, 25);
-				pattern = 13;
-				break;
-
-			case 0xc0:
-				/* Large amount right of center -> large turn to left */
-				handle(-60);
-				motor(4.75, 7.5);
-				break;
-
-			case 0x1:
-				handle(-80);
-				motor(4, 7);
-				break;
-
-			default:
-				break;
-			}
-
-		case 12:
-			/* Check end of large turn to right */
-			if (check_crossline()) {  
-				/* Cross line check during large turn */
-				pattern = 21;
-				break;
-			}
-
-			if (check_rightline()) {   
-				/* Right half line detection check */
-				pattern = 51;
-				break;
-			}
-
-			if (check_leftline()) {    
-				/* Left half line detection check */
-				pattern = 61;
-				break;
-			}
-
-			if (sensor_inp(MASK3_3) == 0x06) {
-				pattern = 11;
-				break;
-			}		
-
-		case 13:
-
-			/* Check end of large turn to left */
-			if (check_crossline()) {   
-				/* Cross line check during large turn */
-				pattern = 21;
-				break;
-			}
-
-			if (check_rightline()) {   
-				/* Right half line detection check */
-				pattern = 51;
-				break;
-			}
-
-			if (check_leftline()) {    
-				/* Left half line detection check */
-				pattern = 61;
-				break;
-			}
-
-			if (sensor_inp(MASK3_3) == 0x60) {
-				pattern = 11;
-				break;
-			}
-			
-		case 21:
-			//start Timer
-			cnt0=0;
-			/* Processing at 1st cross line */
-			led_out(0x2); //LED 3
-			handle(0);
-			// initial break on first line read
-			motor(20, 20);
-			pattern = 22;
-			cnt1 = 0;
-			break;
-			 */
-		case 22:
-			/* check if car is in gap beetween lines */
-			if (check_crossline_gap()) {
-				pattern = 220;
-
-			}
-			//Falls er in diesen Fall hängt, soll er nach 500ms die prüfung überspringen
-			else if(cnt1>500){
-				pattern=23;
-				led_out(0x0); // LED aus
-			}
-			break;
-
-		case 220:
-			/* check if gap car was in Gap and if we pass the 2nd Crossline */
-			if (check_crossline()) { 
-				pattern = 221;
-
-			}
-			break;
-			
-		case 221:		
-			/* check if we passed the 2nd crossline, after passing the gap */
-			if (check_crossline_gap()) {
-
-				//measurement of Speed
-				measuredSpeed = gapDistance/cnt0;
-				pattern = 222;
-				cnt1 = 0;
-				//led_out(0x3);
-			}
-			break;
-			
-		case 222:
-			if (cnt1 > 50) {
-				pattern = 23;
-				cnt1 = 0;
-				while(1){
-					motor(0,0);
-					led_out(0x3); //LED 2+3
-
-				}
-			}
-			break;
-
-		case 23:
-			while(1){
-				motor(0,0);
-			}
-			/* Trace, crank detection after cross line
-			 *
-			 * 1 - reconised Line
-			 * 0 - not recognised track line
-			 * X - deactive Mask Value
-			 * */
-			if ((sensor_inp(MASK3_0) == 0xe0)) { // 111X XXXX				
-				/* Left crank determined -> to left crank clearing processing */
-				led_out(0x1);	//LED2
-				handle(-45);	//standard (10,50)			
-				motor(CURVE_ENTRANCE_MOTOR_POWER, 50);
-				pattern = 31;
-				cnt1 = 0;
-				break;
-			}
-
-			if ((sensor_inp(MASK0_3) == 0x07)) { // XXXX X111			
-				/* Right crank determined -> to right crank clearing processing */
-				handle(45);
-				motor(50, CURVE_ENTRANCE_MOTOR_POWER);
-				pattern = 41;
-				cnt1 = 0;
-				break;
-			}
-
-			switch (sensor_inp(MASK3_3)) {
-
-			case 0x00:
-				/* Center -> straight */
-				handle(0);
-				motor(50, 50);//break hard
-				if ((actualMotorPower == 100) && (!(cnt1 == 0))){
-					cnt1 == 0;
-        }
-				slowDownMotorPower_linear(TIME_FOR_SLOW_DOWN_CURVE);
-				led_out(0x3);
-				motor(actualMotorPower, actualMotorPower);
-				break;
-
-			case 0x04:
-				handle(actualMotorPower * 0.15);		// 0.15 in relation to 100 and 80 with handle 15 in pattern 11
-				motor((actualMotorPower * 0,8), (actualMotorPower * 0,8));
-				break;
-
-			case 0x06:
-			case 0x07:
-			case 0x03:
-				/* Left of center -> turn to right */
-				handle(8);
-				motor(50, 35);
-				break;
-
-			case 0x20:
-				handle(-(actualMotorPower * 0.15));		/// 0.15 in relation to 100 and 80 with handle 15 in pattern 11
-				motor((actualMotorPower * 0,8), (actualMotorPower * 0,8));
-				break;
-
-			case 0x60:
-			case 0xe0:
-			case 0xc0:
-				/* Right of center -> turn to left */
-				handle(-8);
-				motor(35, 50);
-				break;
-
-			default:
-				break;
-			}
-
-		case 31:
-			/* Left crank clearing processing ? wait until stable
-			 * Right crank patterm 41
-			if (cnt1 > 200) {
-				pattern = 32;
-				cnt1 = 0;
-			}
-
-			break;
-			*/
-
-			crankTimer=measuredSpeed*110;
-
-			if(cnt1 > crankTimer){
-				pattern =32;
-				cnt1=0;
-			}
-			break;
-
-
-		case 32:
-			/* Left crank clearing processing ? check end of turn */
-			if (sensor_inp(MASK3_3) == 0x60) {
-				led_out(0x0);
-				pattern = 11;
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 41:
-			/* Right crank clearing processing ? wait until stable */
-			if (cnt1 > 200) {
-				pattern = 42;
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 42:
-			/* Right crank clearing processing ? check end of turn */
-			if (sensor_inp(MASK3_3) == 0x06) {
-				led_out(0x0);
-				pattern = 11;
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 51:
-			/* Processing at 1st right half line detection */
-			led_out(0x1);	//LED 3
-			handle(0);
-			motor(0, 0);
-			pattern = 52;
-			cnt1 = 0;		// Clear Timer
-			break;
-
-		case 52: 
-			/* wait 100ms and go to next pattern [PDF 142] */
-			/* Read but ignore 2nd time */
-			if (cnt1 > 100) {	//wait 100ms
-				led_out(0x2);	//LED 2
-				pattern = 53;
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 53:
-			/* Trace, lane change after right half line detection */
-			if (sensor_inp(MASK4_4) == 0x00) {		// if all sensors reveive null			
-				handle(15);							//standard 15
-				motor(40, 31);
-				pattern = 54;
-				cnt1 = 0;
-				break;
-			}
-
-			switch (sensor_inp(MASK3_3)) {
-
-			case 0x00:
-				/* Center -> straight */
-				handle(0);
-				motor(40, 40);
-				break;
-
-			case 0x04:
-			case 0x06:
-			case 0x07:
-			case 0x03:
-				/* Left of center -> turn to right */
-				handle(8);
-				motor(40, 35);
-				break;
-
-			case 0x20:
-			case 0x60:
-			case 0xe0:
-			case 0xc0:
-				/* Right of center -> turn to left */
-				handle(-8);
-				motor(35, 40);
-				break;
-
-			default:
-				break;
-			}
-
-		case 54:
-			/* Right lane change end check 
-			standard ..== 0x3c
-			Issue #4
-			Issue#10	*/
-			if ((sensor_inp(MASK4_4) == 0x18)||
-			   (sensor_inp(MASK4_4) == 0x0c) ||
-			   (sensor_inp(MASK4_4) == 0x8c)) {
-				led_out(0x0);
-				pattern = 11;
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 61:
-			/* Processing at 1st left half line detection */
-			led_out(0x1);
-			handle(0);
-			motor(0, 0);
-			pattern = 62;
-			cnt1 = 0;
-			break;
-
-		case 62:
-			/* Read but ignore 2nd time */
-			if (cnt1 > 100) {
-				pattern = 63;
-				cnt1 = 0;
-			}
-
-			break;
-
-		case 63:
-			/* Trace, lane change after left half line detection */
-			if (sensor_inp(MASK4_4) == 0x00) {
-				handle(-15);
-				motor(31, 40);
-				pattern = 64;
-				cnt1 = 0;
-				break;
-			}
-
-			switch (sensor_inp(MASK3_3)) {
-
-			case 0x00:
-				/* Center -> straight */
-				handle(0);
-				motor(40, 40);
-				break;
-
-			case 0x04:
-			case 0x06:
-			case 0x07:
-			case 0x03:
-				/* Left of center -> turn to right */
-				handle(8);
-				motor(40, 35);
-				break;
-
-			case 0x20:
-			case 0x60:
-			case 0xe0:
-			case 0xc0:
-				/* Right of center -> turn to left */
-				handle(-8);
-				motor(35, 40);
-				break;
-
-			default:
-				break;
-			}
-
-		case 64:
-			/* Left lane change end check */
-			/* Standard 0x3c
-			 * Issue #4
-			 * Issue#10
-			 */
-			if ((sensor_inp(MASK4_4) == 0x18) ||
-				(sensor_inp(MASK4_4) == 0xc0) ||
-			   (sensor_inp(MASK4_4) == 0xc8)) {
-				led_out(0x0);
-				pattern = 11;
-				cnt1 = 0;
-			}
-
-			break;
-
-		default:
-			/* If neither, return to standby state */
-			pattern = 0;
-			break;
+		control_wait();
+		sensor_sample();
+		analog_update();
+		line_update();
+		odometry_update();
+		state_step();
+		brake_update();
+		speed_control();
+		actuator_commit();
+		control_done();
+	}
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Sleep until the next control step is due                       */
+/***********************************************************************/
+void control_wait(void) {
+	if (timers[TIMER_CONTROL].period == 0) {
+		timer_start(TIMER_CONTROL, CONTROL_PERIOD_MS, 1);
+		controlStats.period = CONTROL_PERIOD_MS * HIRES_PER_MS;
+	}
+	while (!timer_expired(TIMER_CONTROL)) {
+		hal_wait_interrupt();
+	}
+	controlStart = timestamp();
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Account the control step that just ended                       */
+/***********************************************************************/
+void control_done(void) {
+	unsigned long late, exec, elapsed;
+
+	exec = timestamp() - controlStart;
+	if (exec > 0xffff) {
+		exec = 0xffff;
+	}
+
+	controlStats.steps++;
+	controlStats.last = (unsigned short)exec;
+	if (controlStats.wcet < exec) {
+		controlStats.wcet = (unsigned short)exec;
+	}
+
+	/* Started late or ran long: the next step is already due */
+	elapsed = timer_elapsed(TIMER_CONTROL);
+	if (elapsed >= CONTROL_PERIOD_MS) {
+		controlStats.misses++;
+		late = elapsed / CONTROL_PERIOD_MS - 1;
+		controlStats.skipped += late;
+		timers[TIMER_CONTROL].start += late * CONTROL_PERIOD_MS;
+	}
+	else {
+		controlStats.idle += controlStats.period - exec;
+	}
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		State machine engine, one pass                                 */
+/*		entry (first pass in the state), sensor event transitions,     */
+/*		tick handler, timeout, unconditional next, in this order       */
+/***********************************************************************/
+void state_step(void) {
+	const struct state *s;
+	unsigned char next;
+
+	if (pattern < 0 || pattern > PATTERN_MAX || !states[pattern]) {
+		/* If neither, return to standby state */
+		pattern = 0;
+	}
+	s = states[pattern];
+
+	if (pattern != statePattern) {
+		statePattern = pattern;
+		timer_start(TIMER_STATE, 0, 0);
+		travel_start(TRAVEL_STATE);
+		if (s->entry) {
+			s->entry();
 		}
 	}
+
+	next = s->on_event[SENSOR_EVENT_INDEX(sensorFrame.code)];
+	if (next == STAY && s->tick) {
+		next = s->tick();
+	}
+	if (next == STAY && s->timeout && timer_elapsed(TIMER_STATE) > s->timeout) {
+		next = s->on_timeout;
+	}
+	if (next == STAY) {
+		next = s->next;
+	}
+	if (next != STAY) {
+		pattern = next;
+	}
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		LED flashing processing, LED 2 and 3 alternate every period    */
+/***********************************************************************/
+void flash_leds(unsigned long period) {
+	led_out((timer_elapsed(TIMER_STATE) / period) & 1 ? 0x2 : 0x1);
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		State handlers, see states[]                                   */
+/*		tick handlers return the next pattern or STAY                  */
+/***********************************************************************/
+unsigned char state_0_tick(void) {
+	/* Wait for switch input */
+	if (pushsw_get()) {
+		return 1;
+	}
+	flash_leds(100);
+	return STAY;
+}
+
+unsigned char state_1_tick(void) {
+	/* Check if start bar is open */
+	if (!startbar_get()) {
+		/* Start!! */
+		led_out(0x0);
+		return 11;
+	}
+	flash_leds(50);
+	return STAY;
+}
+
+unsigned char state_11_tick(void) {
+#if LINE_PD
+	/* Normal trace, PD steering on the line estimate; traceTable only
+	 * sets the power, line lost keeps the last row */
+	enum trace_row row = SENSOR_ROW(sensorFrame.code);
+
+	if (SENSOR_EVENT(sensorFrame.code) != SENSOR_LOST && row != TRACE_ROWS) {
+		traceRow = row;
+	}
+	drive(steer_pd(), traceTable[traceRow].power);
+	if (row == TRACE_00) {
+		led_out(0x01);
+	}
+	else if (row == TRACE_20) {
+		led_out(0x02);
+	}
+	return STAY;
+#else
+	/* Normal trace, line lost (0x00) keeps the TRACE_00 reaction */
+	switch (SENSOR_ROW(sensorFrame.code)) {
+
+	case TRACE_00:
+		/* Center -> straight */
+		trace(TRACE_00);
+		led_out(0x01);
+		break;
+
+		//Right Turn
+	case TRACE_04:
+		/* Slight amount left of center -> slight turn to right */
+		trace(TRACE_04);
+		break;
+
+	case TRACE_06:
+		/* Small amount left of center -> small turn to right */
+		trace(TRACE_06);
+		break;
+
+	case TRACE_07:
+		/* Medium amount left of center -> medium turn to right */
+		trace(TRACE_07);
+		return 12;
+
+	case TRACE_03:
+		/* Large amount left of center -> large turn to right */
+		trace(TRACE_03);
+		break;
+
+	case TRACE_20:
+		/* Slight amount right of center -> slight turn to left */
+		trace(TRACE_20);
+		led_out(0x02);
+		break;
+
+	case TRACE_60:
+		/* Small amount right of center -> small turn to left */
+		trace(TRACE_60);
+		break;
+
+	case TRACE_E0:
+		/* Medium amount right of center -> medium turn to left */
+		trace(TRACE_E0);
+		return 13;
+
+	case TRACE_C0:
+		/* Large amount right of center -> large turn to left */
+		trace(TRACE_C0);
+		break;
+
+	case TRACE_01:
+		trace(TRACE_01);
+		break;
+
+	default:
+		break;
+	}
+	return STAY;
+#endif
+}
+
+unsigned char state_12_tick(void) {
+	/* Check end of large turn to right */
+	return SENSOR_ROW(sensorFrame.code) == TRACE_06 ? 11 : STAY;
+}
+
+unsigned char state_13_tick(void) {
+	/* Check end of large turn to left */
+	return SENSOR_ROW(sensorFrame.code) == TRACE_60 ? 11 : STAY;
+}
+
+void state_21_entry(void) {
+	/* Processing at 1st cross line */
+	//start Timer, the captured edge if the sample interrupt saw it
+	crosslineStamp = crosslineCapture.phase == CAPTURE_LINE1 ? crosslineCapture.start : timestamp();
+	led_out(0x2); //LED 3
+	handle(0);
+	// brake down to the approach speed, from the encoder speed on the line
+	motor(CRANK_APPROACH_POWER, CRANK_APPROACH_POWER);
+	brake_start(odometry.speed_avg, fx_mul(speedFactor, SPEED_PER_POWER * CRANK_APPROACH_POWER));
+}
+
+unsigned char state_22_tick(void) {
+	/* check if car is in gap beetween lines */
+	if (check_crossline_gap()) {
+		return 220;
+	}
+	//Falls er in diesen Fall hängt, soll er nach 500ms die prüfung überspringen
+	if (timer_elapsed(TIMER_STATE) > 500) {
+		led_out(0x0); // LED aus
+		travel_start(TRAVEL_CROSSLINE);
+		return 23;
+	}
+	return STAY;
+}
+
+unsigned char state_221_tick(void) {
+	/* check if we passed the 2nd crossline, after passing the gap */
+	if (check_crossline_gap()) {
+		//measurement of Speed, from the captured edges when complete
+		if (crosslineCapture.phase == CAPTURE_DONE && crosslineCapture.start == crosslineStamp) {
+			measuredSpeed = fx_div_int(gapDistance * (int)HIRES_PER_MS,
+									   (int)(crosslineCapture.end - crosslineCapture.start));
+		}
+		else {
+			measuredSpeed = fx_div_int(gapDistance * (int)HIRES_PER_MS, (int)(timestamp() - crosslineStamp));
+		}
+		//led_out(0x3);
+		travel_start(TRAVEL_CROSSLINE);
+		return 222;
+	}
+	return STAY;
+}
+
+unsigned char state_222_tick(void) {
+	/* Short distance to avoid wrong detection */
+	if (travel_elapsed(TRAVEL_STATE) > CROSSLINE_BLANK_MM) {
+		led_out(0x3); //LED 2+3
+		return 23;
+	}
+	return STAY;
+}
+
+unsigned char state_23_tick(void) {
+#if !CRANK_DETECTION
+	/* Stop after the cross line, speed measurement test */
+	motor(0, 0);
+	return STAY;
+#else
+	/* Trace, crank detection after cross line
+	 *
+	 * 1 - reconised Line
+	 * 0 - not recognised track line
+	 * X - deactive Mask Value
+	 * */
+	if (travel_elapsed(TRAVEL_CROSSLINE) > CRANK_SEARCH_MM) {
+		/* Cranks are 500mm after the cross lines, this was none */
+		led_out(0x0);
+		return 11;
+	}
+
+	if ((sensor_inp(MASK3_0) == 0xe0)) { // 111X XXXX
+		/* Left crank determined -> to left crank clearing processing */
+		led_out(0x1);	//LED2
+		handle(-45);	//standard (10,50)
+		motor(CURVE_ENTRANCE_MOTOR_POWER, 50);
+		return 31;
+	}
+
+	if ((sensor_inp(MASK0_3) == 0x07)) { // XXXX X111
+		/* Right crank determined -> to right crank clearing processing */
+		handle(45);
+		motor(50, CURVE_ENTRANCE_MOTOR_POWER);
+		return 41;
+	}
+
+	switch (sensor_inp(MASK3_3)) {
+
+	case 0x00:
+		/* Center -> straight, braked to the approach speed since pattern 21 */
+		handle(0);
+		actualMotorPower = CRANK_APPROACH_POWER;
+		led_out(0x3);
+		motor(actualMotorPower, actualMotorPower);
+		break;
+
+	case 0x04:
+		handle(actualMotorPower * 15 / 100);		// 0.15 in relation to 100 and 80 with handle 15 in pattern 11
+		motor(actualMotorPower * 8 / 10, actualMotorPower * 8 / 10);
+		break;
+
+	case 0x06:
+	case 0x07:
+	case 0x03:
+		/* Left of center -> turn to right */
+		handle(8);
+		motor(50, 35);
+		break;
+
+	case 0x20:
+		handle(-(actualMotorPower * 15 / 100));		/// 0.15 in relation to 100 and 80 with handle 15 in pattern 11
+		motor(actualMotorPower * 8 / 10, actualMotorPower * 8 / 10);
+		break;
+
+	case 0x60:
+	case 0xe0:
+	case 0xc0:
+		/* Right of center -> turn to left */
+		handle(-8);
+		motor(35, 50);
+		break;
+
+	default:
+		break;
+	}
+	return STAY;
+#endif
+}
+
+unsigned char state_31_tick(void) {
+	/* Left crank clearing processing ? wait until stable */
+	return travel_elapsed(TRAVEL_STATE) > CRANK_TURN_MM ? 32 : STAY;
+}
+
+unsigned char state_41_tick(void) {
+	/* Right crank clearing processing ? wait until stable */
+	return travel_elapsed(TRAVEL_STATE) > CRANK_TURN_MM ? 42 : STAY;
+}
+
+unsigned char state_32_tick(void) {
+	/* Left crank clearing processing ? check end of turn */
+	if (SENSOR_ROW(sensorFrame.code) == TRACE_60) {
+		led_out(0x0);
+		return 11;
+	}
+	return STAY;
+}
+
+unsigned char state_42_tick(void) {
+	/* Right crank clearing processing ? check end of turn */
+	if (SENSOR_ROW(sensorFrame.code) == TRACE_06) {
+		led_out(0x0);
+		return 11;
+	}
+	return STAY;
+}
+
+void state_51_entry(void) {
+	/* Processing at 1st right half line detection, on at the straight
+	 * line power */
+	led_out(0x1);	//LED 3
+	lane_trace();
+}
+
+unsigned char state_52_tick(void) {
+	/* Past the right half line */
+	lane_trace();
+	return STAY;
+}
+
+void state_53_entry(void) {
+	/* wait 100ms in pattern 52 is over [PDF 142] */
+	led_out(0x2);	//LED 2
+}
+
+/* Trace with the line in sight during a lane change, straight line power */
+void lane_trace(void) {
+#if LINE_PD
+	drive(steer_pd(), traceTable[TRACE_00].power);
+#else
+	int power = traceTable[TRACE_00].power;
+
+	switch (SENSOR_ROW(sensorFrame.code)) {
+
+	case TRACE_00:
+		/* Center -> straight */
+		drive(0, power);
+		break;
+
+	case TRACE_04:
+	case TRACE_06:
+	case TRACE_07:
+	case TRACE_03:
+		/* Left of center -> turn to right, was drive(8, 38) at 40 */
+		drive(8, power * 19 / 20);
+		break;
+
+	case TRACE_20:
+	case TRACE_60:
+	case TRACE_E0:
+	case TRACE_C0:
+		/* Right of center -> turn to left */
+		drive(-8, power * 19 / 20);
+		break;
+
+	default:
+		break;
+	}
+#endif
+}
+
+unsigned char state_53_tick(void) {
+	/* Trace, lane change after right half line detection */
+	if (sensor_inp(MASK4_4) == 0x00) {		// if all sensors reveive null
+		lane_plan(1);						// was drive(15, 36) until 0x18, 0x0c or 0x8c
+		return 54;
+	}
+	lane_trace();
+	return STAY;
+}
+
+unsigned char state_54_tick(void) {
+	/* Right lane change S curve, until the new lane is seen */
+	return lane_follow();
+}
+
+void state_61_entry(void) {
+	/* Processing at 1st left half line detection */
+	led_out(0x1);
+	lane_trace();
+}
+
+unsigned char state_62_tick(void) {
+	/* Past the left half line */
+	lane_trace();
+	return STAY;
+}
+
+unsigned char state_63_tick(void) {
+	/* Trace, lane change after left half line detection */
+	if (sensor_inp(MASK4_4) == 0x00) {
+		lane_plan(-1);						// was drive(-15, 36) until 0x18, 0xc0 or 0xc8
+		return 64;
+	}
+	lane_trace();
+	return STAY;
+}
+
+unsigned char state_64_tick(void) {
+	/* Left lane change S curve, until the new lane is seen */
+	return lane_follow();
 }
 
 /***********************************************************************/
 /* RX62T Initialization                                                */
 /***********************************************************************/
 void init(void) {
-	/* System Clock */
-	SYSTEM.SCKCR.BIT.ICK = 0;               //12.288*8=98.304MHz
-	SYSTEM.SCKCR.BIT.PCK = 1;               //12.288*4=49.152MHz
-
-	/* Port I/O Settings */
-	PORT1.DDR.BYTE = 0x03;                  //P10:LED2 in motor drive board
-	PORT2.DR.BYTE = 0x08;
-	PORT2.DDR.BYTE = 0x1b;                  //P24:SDCARD_CLK(o)
-											//P23:SDCARD_DI(o)
-											//P22:SDCARD_DO(i)
-											//CN:P21-P20
-	PORT3.DR.BYTE = 0x01;
-	PORT3.DDR.BYTE = 0x0f;                  //CN:P33-P31
-											//P30:SDCARD_CS(o)
-	//PORT4:input                           //sensor input
-	//PORT5:input
-	//PORT6:input
-	PORT7.DDR.BYTE = 0x7e;                  //P76:LED3 in motor drive board
-											//P75:forward reverse signal(right motor)
-											//P74:forward reverse signal(left motor)
-											//P73:PWM(right motor)
-											//P72:PWM(left motor)
-											//P71:PWM(servo motor)
-											//P70:Push-button in motor drive board
-	PORT8.DDR.BYTE = 0x07;                  //CN:P82-P80
-	PORT9.DDR.BYTE = 0x7f;                  //CN:P96-P90
-	PORTA.DR.BYTE = 0x0f;                  //CN:PA5-PA4
-											//PA3:LED3(o)
-											//PA2:LED2(o)
-											//PA1:LED1(o)
-											//PA0:LED0(o)
-	PORTA.DDR.BYTE = 0x3f;                  //CN:PA5-PA0
-	PORTB.DDR.BYTE = 0xff;                  //CN:PB7-PB0
-	PORTD.DDR.BYTE = 0x0f;                  //PD7:TRST#(i)
-											//PD5:TDI(i)
-											//PD4:TCK(i)
-											//PD3:TDO(o)
-											//CN:PD2-PD0
-	PORTE.DDR.BYTE = 0x1b;                  //PE5:SW(i)
-											//CN:PE4-PE0
-
-	/* Compare match timer */
-	MSTP_CMT0 = 0;                          //CMT Release module stop state
-	MSTP_CMT2 = 0;                          //CMT Release module stop state
-
-	ICU.IPR[0x04].BYTE = 0x0f;             //CMT0_CMI0 Priority of interrupts
-	ICU.IER[0x03].BIT.IEN4 = 1;             //CMT0_CMI0 Permission for interrupt
-	CMT.CMSTR0.WORD = 0x0000;				//CMT0,CMT1 Stop counting
-	CMT0.CMCR.WORD = 0x00C3;				//PCLK/512
-	CMT0.CMCNT = 0;
-	CMT0.CMCOR = 96;						//1ms/(1/(49.152MHz/512))
-	CMT.CMSTR0.WORD = 0x0003;				//CMT0,CMT1 Start counting
-
-	/* MTU3_3 MTU3_4 PWM mode synchronized by RESET */
-	MSTP_MTU = 0;							//Release module stop state
-	MTU.TSTRA.BYTE = 0x00;					//MTU Stop counting
-
-	MTU3.TCR.BYTE = 0x23;					//ILCK/64(651.04ns)
-	MTU3.TCNT = MTU4.TCNT = 0;              //MTU3,MTU4TCNT clear
-	MTU3.TGRA = MTU3.TGRC = PWM_CYCLE;      //cycle(16ms)
-	MTU3.TGRB = MTU3.TGRD = SERVO_CENTER;   //PWM(servo motor)
-	MTU4.TGRA = MTU4.TGRC = 0;              //PWM(left motor)
-	MTU4.TGRB = MTU4.TGRD = 0;              //PWM(right motor)
-	MTU.TOCR1A.BYTE = 0x40;                 //Selection of output level
-	MTU3.TMDR1.BYTE = 0x38;                 //TGRC,TGRD buffer function
-											//PWM mode synchronized by RESET
-	MTU4.TMDR1.BYTE = 0x00;                 //Set 0 to exclude MTU3 effects
-	MTU.TOERA.BYTE = 0xc7;                 //MTU3TGRB,MTU4TGRA,MTU4TGRB permission for output
-	MTU.TSTRA.BYTE = 0x40;                 //MTU0,MTU3 count function
+#if SENSOR_ANALOG
+	int i;
+#endif
+
+	hal_init(PWM_CYCLE, SERVO_CENTER, MOTOR_PWM_CYCLE);
+
+#if SENSOR_ANALOG
+	for (i = 0; i < HAL_ANALOG_CHANNELS; i++) {
+		sensorAnalog.white[i] = ANALOG_WHITE;
+		sensorAnalog.black[i] = ANALOG_BLACK;
+	}
+	hal_analog_init(&analogScan);
+#endif
 }
 
 /***********************************************************************/
@@ -772,8 +1131,204 @@ void init(void) {
 /***********************************************************************/
 #pragma interrupt Excep_CMT0_CMI0(vect=28)
 void Excep_CMT0_CMI0(void) {
-	cnt0++;
-	cnt1++;
+	msTicks++;
+}
+
+#pragma interrupt Excep_CMT1_CMI1(vect=29)
+void Excep_CMT1_CMI1(void) {
+	crossline_capture(hal_sensor_read(), timestamp());
+}
+
+#pragma interrupt Excep_CMT2_CMI2(vect=30)
+void Excep_CMT2_CMI2(void) {
+	hiresWraps++;
+}
+
+/* Only when a DTC ring is full, the single scans go to the DTC */
+#pragma interrupt Excep_S12AD0_S12ADI0(vect=102)
+void Excep_S12AD0_S12ADI0(void) {
+	hal_analog_rearm(&analogScan, 0);
+}
+
+#pragma interrupt Excep_S12AD1_S12ADI1(vect=103)
+void Excep_S12AD1_S12ADI1(void) {
+	hal_analog_rearm(&analogScan, 1);
+}
+
+#pragma interrupt Excep_GPT1_GTCIV1(vect=184)
+void Excep_GPT1_GTCIV1(void) {
+	actuator_apply();
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		High resolution timestamp, CMT2 extended to 32 bit             */
+/*		wraps after 699 s, differences of two timestamps stay valid    */
+/* Return values:				                                       */
+/*		counts, HAL_HIRES_HZ (0.163 us)                                */
+/***********************************************************************/
+unsigned long timestamp(void) {
+	unsigned long wraps;
+	unsigned short count;
+	int pending;
+
+	/* Retry when CMI2 was raised or serviced between the reads */
+	do {
+		wraps = hiresWraps;
+		pending = hal_hires_pending();
+		count = hal_hires_count();
+	} while (wraps != hiresWraps || pending != hal_hires_pending());
+
+	/* CMI2 is raised at 0xffff, a lower count belongs to the next wrap */
+	if (pending && count != 0xffff) {
+		wraps++;
+	}
+	return (wraps << 16) | count;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Double cross line edge capture, every HAL_SAMPLE_HZ sample     */
+/*		same line and gap tests as check_crossline() and               */
+/*		check_crossline_gap()                                          */
+/* Arguments:						                                   */
+/*		sensor: line sensors, 1: line detected                         */
+/*		now:    timestamp() of the sample                              */
+/***********************************************************************/
+void crossline_capture(unsigned char sensor, unsigned long now) {
+	volatile struct crossline_capture *c = &crosslineCapture;
+	int line = SENSOR_EVENT(sensorClass[sensor]) == SENSOR_CROSSLINE;
+	int gap = (sensor & MASK2_0) == 0x00 || (sensor & MASK0_2) == 0x00;
+
+	if (c->phase != CAPTURE_IDLE && c->phase != CAPTURE_DONE && now - c->start > CAPTURE_TIMEOUT) {
+		c->phase = CAPTURE_IDLE;
+	}
+
+	switch (c->phase) {
+
+	case CAPTURE_IDLE:
+	case CAPTURE_DONE:
+		if (line) {
+			c->start = now;
+			c->phase = CAPTURE_LINE1;
+		}
+		break;
+
+	case CAPTURE_LINE1:
+		if (gap) {
+			c->phase = CAPTURE_GAP;
+		}
+		break;
+
+	case CAPTURE_GAP:
+		if (line) {
+			c->phase = CAPTURE_LINE2;
+		}
+		break;
+
+	case CAPTURE_LINE2:
+		if (gap) {
+			c->end = now;
+			c->phase = CAPTURE_DONE;
+		}
+		break;
+
+	default:
+		c->phase = CAPTURE_IDLE;
+		break;
+	}
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		timestamp() counts to microseconds, without 32 bit overflow    */
+/***********************************************************************/
+unsigned long timestamp_us(unsigned long counts) {
+	return counts / HIRES_PER_MS * 1000 + counts % HIRES_PER_MS * 1000 / HIRES_PER_MS;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Current time as msTicks and CMT0 count, consistent pair        */
+/* Arguments:						                                   */
+/*		ms:     msTicks                                                */
+/*		count:  CMT0 counts since ms, HAL_TICK_COUNT_NS each           */
+/***********************************************************************/
+void clock_read(unsigned long *ms, unsigned short *count) {
+	unsigned long t;
+	int pending;
+
+	/* Retry when CMI0 was raised or serviced between the reads */
+	do {
+		t = msTicks;
+		pending = hal_tick_pending();
+		*count = hal_tick_count();
+	} while (t != msTicks || pending != hal_tick_pending());
+
+	/* Count already wrapped, the interrupt has not run yet */
+	*ms = pending ? t + 1 : t;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Software timer start                                           */
+/* Arguments:						                                   */
+/*		id:       timer                                                */
+/*		period:   ms until timer_expired(), 0: stopwatch only          */
+/*		periodic: 1: restart by itself every period                    */
+/***********************************************************************/
+void timer_start(enum timer_id id, unsigned long period, unsigned char periodic) {
+	timers[id].start = msTicks;
+	timers[id].period = period;
+	timers[id].periodic = periodic;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Software timer reading                                         */
+/* Return values:				                                       */
+/*		ms since the timer was (re)started                             */
+/***********************************************************************/
+unsigned long timer_elapsed(enum timer_id id) {
+	return msTicks - timers[id].start;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Software timer expiry                                          */
+/*		a periodic timer restarts one period later, so it keeps its    */
+/*		phase even when checked late                                   */
+/* Return values:				                                       */
+/*		1: period is over                                              */
+/***********************************************************************/
+int timer_expired(enum timer_id id) {
+	struct soft_timer *t = &timers[id];
+
+	if (t->period == 0 || msTicks - t->start < t->period) {
+		return 0;
+	}
+	if (t->periodic) {
+		t->start += t->period;
+	}
+	return 1;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Travel mark (re)start at the current odometry.travel_mm        */
+/***********************************************************************/
+void travel_start(enum travel_id id) {
+	travelMarks[id] = odometry.travel_mm;
+}
+
+/***********************************************************************/
+/* Definition:                                                         */
+/*		Travel mark reading                                            */
+/* Return values:				                                       */
+/*		mm since the mark was (re)started, negative backwards          */
+/***********************************************************************/
+long travel_elapsed(enum travel_id id) {
+	return odometry.travel_mm - travelMarks[id];
 }
 
 /***********************************************************************/
@@ -783,8 +1338,192 @@ void Excep_CMT0_CMI0(void) {
 /*		timer:  value, 1 = 1 ms									       */
 /***********************************************************************/
 void timer(unsigned long timer_set) {
-	cnt0 = 0;
-	while (cnt0 < timer_set);
+	timer_start(TIMER_DELAY, timer_set, 0);
+	while (!timer_expired(TIMER_DELAY)) {
+		hal_wait_interrupt();
+	}
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Sample the line sensors into sensorFrame                       */
+/*		Once per main loop pass, so every check_* and mask test of     */
+/*		one decision sees the same physical frame                      */
+/***********************************************************************/
+void sensor_sample(void) {
+	sensorFrame.sensor = hal_sensor_read();
+	sensorFrame.code = sensorClass[sensorFrame.sensor];
+	sensorFrame.time = msTicks;
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Calibrated analog sensor levels, once per control step         */
+/*		Level = how far the raw value is from the floor towards the    */
+/*		line, between the extremes seen so far, so every sensor gets   */
+/*		its own span. The centroid of the levels is the line position  */
+/*		between the sensors                                            */
+/***********************************************************************/
+void analog_update(void) {
+#if SENSOR_ANALOG
+	struct sensor_analog *a = &sensorAnalog;
+	long sum = 0;
+	int64_t moment = 0;
+	int i;
+
+	if (!hal_analog_read(&analogScan, a->raw)) {
+		a->valid = 0;
+		return;
+	}
+	for (i = 0; i < HAL_ANALOG_CHANNELS; i++) {
+		if (a->raw[i] < a->white[i]) {
+			a->white[i] = a->raw[i];
+		}
+		if (a->raw[i] > a->black[i]) {
+			a->black[i] = a->raw[i];
+		}
+		a->level[i] = (unsigned short)((long)(a->black[i] - a->raw[i]) * 1000 / (a->black[i] - a->white[i]));
+		sum += a->level[i];
+		moment += (int64_t)a->level[i] * sensorY[i];
+	}
+	a->valid = sum >= ANALOG_LINE;
+	a->position = a->valid ? (fx_t)(moment / sum) : 0;
+#endif
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Line position estimate, once per control step                  */
+/*		The frame only tells which sensor cell the line is in. On a    */
+/*		transition the line is on the border of the two cells and its  */
+/*		rate follows from the last two borders; in between the offset  */
+/*		is extrapolated with that rate, but not out of the cell        */
+/***********************************************************************/
+void line_update(void) {
+	struct line_estimate *e = &lineEstimate;
+	unsigned long now = sensorFrame.time;
+	unsigned long elapsed;
+	fx_t raw, boundary, far;
+
+	/* Analog centroid while it sees the line, rate low pass filtered */
+	if (sensorAnalog.valid) {
+		e->rate += (fx_sat((int64_t)(sensorAnalog.position - e->offset) * (1000 / CONTROL_PERIOD_MS)) - e->rate) / LINE_RATE_FILTER;
+		e->offset = sensorAnalog.position;
+		return;
+	}
+
+	if (sensorFrame.sensor == 0x00) {
+		/* Beyond the outermost sensor, on the side it was last seen */
+		e->offset = fx_from_int(e->offset >= 0 ? LINE_LOST_MM : -LINE_LOST_MM);
+		e->rate = 0;
+		return;
+	}
+
+	raw = linePos[sensorFrame.sensor];
+	if (raw != e->raw) {
+		boundary = (raw + e->raw) / 2;
+		elapsed = now - e->changed;
+		if (elapsed > 0 && elapsed <= LINE_RATE_HOLD_MS) {
+			e->rate = (boundary - e->boundary) / (fx_t)elapsed * 1000;
+		}
+		else {
+			e->rate = 0;
+		}
+		e->raw = raw;
+		e->boundary = boundary;
+		e->changed = now;
+	}
+
+	elapsed = now - e->changed;
+	if (elapsed > LINE_RATE_HOLD_MS) {
+		e->rate = 0;
+	}
+
+	/* From the border towards, at most, the opposite border of the cell */
+	e->offset = e->boundary + e->rate / 1000 * (fx_t)elapsed;
+	far = 2 * e->raw - e->boundary;
+	if ((far >= e->boundary && e->offset > far) || (far < e->boundary && e->offset < far)) {
+		e->offset = far;
+	}
+	if ((far >= e->boundary && e->offset < e->boundary) || (far < e->boundary && e->offset > e->boundary)) {
+		e->offset = e->boundary;
+	}
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		PD steering on the line estimate, gains by odometry speed      */
+/* Return values:				                                       */
+/*		handle() angle, positive right                                 */
+/***********************************************************************/
+int steer_pd(void) {
+	const struct steer_gain *g;
+	fx_t speed = odometry.speed_avg;
+	fx_t frac, kp, kd;
+	int row, angle;
+
+	/* Linear between the rows of the two neighbouring whole m/s */
+	if (speed < 0) {
+		speed = 0;
+	}
+	row = fx_to_int(speed);
+	if (row >= STEER_GAIN_ROWS - 1) {
+		g = &steerGain[STEER_GAIN_ROWS - 1];
+		kp = g->kp;
+		kd = g->kd;
+	}
+	else {
+		g = &steerGain[row];
+		frac = speed - fx_from_int(row);
+		kp = g->kp + fx_mul(g[1].kp - g->kp, frac);
+		kd = g->kd + fx_mul(g[1].kd - g->kd, frac);
+	}
+
+	/* Line to the left (positive) -> turn left (negative angle) */
+	angle = -fx_to_int(fx_mul(kp, lineEstimate.offset) + fx_mul(kd, lineEstimate.rate));
+	if (angle > MAXIMUM_ANGLE) {
+		angle = MAXIMUM_ANGLE;
+	}
+	if (angle < -MAXIMUM_ANGLE) {
+		angle = -MAXIMUM_ANGLE;
+	}
+	return angle;
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Wheel encoder distance and speed, once per control step        */
+/***********************************************************************/
+void odometry_update(void) {
+	unsigned short raw[WHEELS];
+	struct odometry_sample *old = &odometryHistory[odometryIndex];
+	unsigned long now, us;
+	short delta;
+	int w;
+
+	raw[WHEEL_LEFT] = hal_encoder_left();
+	raw[WHEEL_RIGHT] = hal_encoder_right();
+	now = timestamp();
+	us = timestamp_us(now - old->time);
+
+	for (w = 0; w < WHEELS; w++) {
+		/* 16 bit difference, fine while a step is under 13m of travel */
+		delta = (short)(raw[w] - odometryRaw[w]);
+		odometryRaw[w] = raw[w];
+		odometry.counts[w] += delta;
+		odometry.step_mm[w] = fx_div_int(delta * ENCODER_UM_PER_COUNT, 1000);
+		if (us) {
+			odometry.speed[w] = fx_div_int((int)(odometry.counts[w] - old->counts[w]) * ENCODER_UM_PER_COUNT,
+										   (int)us);
+		}
+		old->counts[w] = odometry.counts[w];
+	}
+	odometry.speed_avg = (odometry.speed[WHEEL_LEFT] + odometry.speed[WHEEL_RIGHT]) / 2;
+	odometry.travel_mm = (long)((long long)(odometry.counts[WHEEL_LEFT] + odometry.counts[WHEEL_RIGHT]) *
+								ENCODER_UM_PER_COUNT / 2000);
+
+	old->time = now;
+	odometryIndex = (odometryIndex + 1) % ODOMETRY_WINDOW;
 }
 
 /***********************************************************************/
@@ -793,14 +1532,10 @@ void timer(unsigned long timer_set) {
 /* Arguments:					                                       */
 /*		masked values												   */
 /* Return values:				                                       */
-/*		sensor value				                                   */
+/*		sensor value of the current sensorFrame                        */
 /***********************************************************************/
 unsigned char sensor_inp(unsigned char mask) {
-	unsigned char sensor;
-	sensor = ~PORT4.PORT.BYTE;
-	sensor &= mask;
-
-	return sensor;
+	return sensorFrame.sensor & mask;
 }
 
 /***********************************************************************/
@@ -812,7 +1547,7 @@ unsigned char sensor_inp(unsigned char mask) {
 /***********************************************************************/
 unsigned char startbar_get(void) {
 	unsigned char b;
-	b = ~PORT4.PORT.BIT.B0 & 0x01;     // Read start bar signal      
+	b = hal_startbar_read();     // Read start bar signal      
 
 	return  b;
 }
@@ -907,12 +1642,8 @@ int check_leftline(void)
 /*		Switch value, 0 to 15										   */
 /***********************************************************************/
 unsigned char dipsw_get(void) {
-	unsigned char sw, d0, d1, d2, d3;
-	d0 = (PORT6.PORT.BIT.B3 & 0x01);		// P63~P60 read                
-	d1 = (PORT6.PORT.BIT.B2 & 0x01) << 1;
-	d2 = (PORT6.PORT.BIT.B1 & 0x01) << 2;
-	d3 = (PORT6.PORT.BIT.B0 & 0x01) << 3;
-	sw = d0 | d1 | d2 | d3;
+	unsigned char sw;
+	sw = hal_dipsw_read();		// P63~P60 read                
 
 	return  sw;
 }
@@ -925,7 +1656,7 @@ unsigned char dipsw_get(void) {
 /***********************************************************************/
 unsigned char buttonsw_get(void) {
 	unsigned char sw;
-	sw = ~PORTE.PORT.BIT.B5 & 0x01;     // Read ports with switches 
+	sw = hal_buttonsw_read();     // Read ports with switches 
 
 	return  sw;
 }
@@ -938,7 +1669,7 @@ unsigned char buttonsw_get(void) {
 /***********************************************************************/
 unsigned char pushsw_get(void) {
 	unsigned char sw;
-	sw = ~PORT7.PORT.BIT.B0 & 0x01;    // Read ports with switches   
+	sw = hal_pushsw_read();    // Read ports with switches   
 
 	return  sw;
 }
@@ -950,8 +1681,7 @@ unsigned char pushsw_get(void) {
 /*		Switch value, LED0: bit 0, LED1: bit 1. 0: dark, 1: lit		   */
 /***********************************************************************/
 void led_out_m(unsigned char led) {
-	led = ~led;
-	PORTA.DR.BYTE = led & 0x0f;
+	hal_led_m_write(led);
 }
 
 /***********************************************************************/
@@ -963,14 +1693,14 @@ void led_out_m(unsigned char led) {
 /*		0x3 -> LED1: ON, LED0: ON, 0x2 -> LED1: ON, LED0: OFF		   */
 /***********************************************************************/
 void led_out(unsigned char led) {
-	led = ~led;
-	PORT7.DR.BIT.B6 = led & 0x01;
-	PORT1.DR.BIT.B0 = (led >> 1) & 0x01;
+	hal_led_write(led);
 }
 
 /***********************************************************************/
 /* Definition:			                                               */
 /*		Motor speed control                                            */
+/*		with SPEED_CONTROL the percentage is a target speed,           */
+/*		SPEED_PER_POWER each, held by speed_control()                  */
 /* Arguments:														   */
 /*		Left motor: -100 to 100, Right motor: -100 to 100			   */
 /*      Here, 0 is stopped, 100 is forward, and -100 is reverse.	   */
@@ -983,34 +1713,100 @@ void motor(int accele_l, int accele_r){
 	accele_r = accele_r * sw_data / 20; */
 
 	/* use speedFactor instead */
-	accele_l = accele_l * speedFactor;
-	accele_r = accele_r * speedFactor;
+	accele_l = fx_mul_int(speedFactor, accele_l);
+	accele_r = fx_mul_int(speedFactor, accele_r);
+
+
+	if (accele_l > MOTOR_POWER_MAX) accele_l = MOTOR_POWER_MAX;
+	if (accele_l < -MOTOR_POWER_MAX) accele_l = -MOTOR_POWER_MAX;
+	if (accele_r > MOTOR_POWER_MAX) accele_r = MOTOR_POWER_MAX;
+	if (accele_r < -MOTOR_POWER_MAX) accele_r = -MOTOR_POWER_MAX;
+
+#if SPEED_CONTROL
+	/* Target speeds, speed_control() sets the duty */
+	speedPi[WHEEL_LEFT].target = SPEED_PER_POWER * accele_l;
+	speedPi[WHEEL_RIGHT].target = SPEED_PER_POWER * accele_r;
+#else
+	brake.resume[WHEEL_LEFT] = (signed char)accele_l;
+	brake.resume[WHEEL_RIGHT] = (signed char)accele_r;
+	if (!brake.active) {
+		motor_output(WHEEL_LEFT, accele_l);
+		motor_output(WHEEL_RIGHT, accele_r);
+	}
+#endif
+}
 
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Motor duty into the next actuator command                      */
+/* Arguments:														   */
+/*		wheel: WHEEL_LEFT or WHEEL_RIGHT							   */
+/*		power: -100 to 100, negative reverse 						   */
+/***********************************************************************/
+void motor_output(int wheel, int power) {
+	const struct motor_pwm *pwm = &motorPwm[power + MOTOR_POWER_MAX];
 
-	/* Left Motor Control */
-	if (accele_l >= 0) {
-		PORT7.DR.BYTE &= 0xef;
-		MTU4.TGRC = (long)(PWM_CYCLE - 1) * accele_l / 100;
+	actuatorNext.duty[wheel] = pwm->duty;
+	if (!pwm->reverse) {
+		actuatorNext.reverse &= ~(1 << wheel);
 	}
 	else {
-		PORT7.DR.BYTE |= 0x10;
-		MTU4.TGRC = (long)(PWM_CYCLE - 1) * (-accele_l) / 100;
+		actuatorNext.reverse |= 1 << wheel;
 	}
+}
 
-	/* Right Motor Control */
-	if (accele_r >= 0) {
-		PORT7.DR.BYTE &= 0xdf;
-		MTU4.TGRD = (long)(PWM_CYCLE - 1) * accele_r / 100;
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Per wheel PI speed control on the encoder speed, every         */
+/*		control step. Feedforward from the target, the integral only   */
+/*		follows while the output is not saturated in its direction     */
+/***********************************************************************/
+void speed_control(void) {
+#if SPEED_CONTROL
+	struct speed_pi *pi;
+	fx_t error, integral, out;
+	int w;
+
+	if (brake.active) {
+		return;
 	}
-	else {
-		PORT7.DR.BYTE |= 0x20;
-		MTU4.TGRD = (long)(PWM_CYCLE - 1) * (-accele_r) / 100;
+	for (w = 0; w < WHEELS; w++) {
+		pi = &speedPi[w];
+
+		/* Stopped: no holding current, no creeping */
+		if (pi->target == 0 && odometry.speed[w] < SPEED_STOP_BAND && odometry.speed[w] > -SPEED_STOP_BAND) {
+			pi->integral = 0;
+			pi->power = 0;
+			motor_output(w, 0);
+			continue;
+		}
+
+		error = pi->target - odometry.speed[w];
+		integral = pi->integral + fx_mul(SPEED_KI_DT, error);
+		out = fx_mul(SPEED_FEEDFORWARD, pi->target) + fx_mul(SPEED_KP, error);
+
+		/* Anti-windup: keep the integral where it would drive further into the limit */
+		if (!((out + integral > fx_from_int(MOTOR_POWER_MAX) && error > 0) ||
+			  (out + integral < fx_from_int(-MOTOR_POWER_MAX) && error < 0))) {
+			pi->integral = integral;
+		}
+		out += pi->integral;
+
+		if (out > fx_from_int(MOTOR_POWER_MAX)) {
+			out = fx_from_int(MOTOR_POWER_MAX);
+		}
+		if (out < fx_from_int(-MOTOR_POWER_MAX)) {
+			out = fx_from_int(-MOTOR_POWER_MAX);
+		}
+		pi->power = fx_to_int(out);
+		motor_output(w, pi->power);
 	}
+#endif
 }
 
 /***********************************************************************/
 /* Definition:			                                               */
-/*		Servo steering operation                                       */
+/*		Servo steering operation, into the next actuator command       */
 /* Arguments:														   */
 /*		servo operation angle: -90 to 90							   */
 /*      -90: 90-degree turn to left, 0: straight,					   */
@@ -1022,30 +1818,235 @@ void handle(int angle) {
 	if(angle>MAXIMUM_ANGLE)angle = MAXIMUM_ANGLE;
 	if(angle<-MAXIMUM_ANGLE)angle = -MAXIMUM_ANGLE;
 
-	/* When the servo move from left to right in reverse, replace "-" with "+". */
-	MTU3.TGRD = SERVO_CENTER - angle * HANDLE_STEP;
+	actuatorNext.servo = servoPwm[angle + MAXIMUM_ANGLE];
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Hand the command built by this control step to the GPT1        */
+/*		period interrupt, see actuator.h                               */
+/***********************************************************************/
+void actuator_commit(void) {
+	hal_disable_interrupts();
+	if (actuatorPending) {
+		actuatorStats.overwritten++;
+	}
+	actuatorReady = actuatorNext;
+	actuatorPending = 1;
+	hal_enable_interrupts();
+	actuatorStats.commits++;
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		GPT1 cycle end: the duties buffered at the last one are live   */
+/*		now, switch their direction signals, then buffer the pending   */
+/*		command for the next cycle end                                 */
+/***********************************************************************/
+void actuator_apply(void) {
+	hal_motor_dir(actuatorReverse);
+	if (!actuatorPending) {
+		return;
+	}
+	hal_motor_duty(actuatorReady.duty[WHEEL_LEFT], actuatorReady.duty[WHEEL_RIGHT]);
+	hal_servo_write(actuatorReady.servo);
+	actuatorReverse = actuatorReady.reverse;
+	actuatorPending = 0;
+	actuatorStats.applied++;
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Normal trace reaction from traceTable                          */
+/* Arguments:														   */
+/*		row of traceTable: TRACE_00 to TRACE_01						   */
+/***********************************************************************/
+void trace(enum trace_row row) {
+	drive(traceTable[row].angle, traceTable[row].power);
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Steering with the electronic differential: both rear wheels    */
+/*		roll on their turning circle (diffWheels) without scrubbing,   */
+/*		scaled down together when the outer one would exceed 100       */
+/* Arguments:														   */
+/*		angle: handle() angle, positive right, clamped to MAXIMUM_ANGLE*/
+/*		power: motor() power of the rear axle center, -100 to 100      */
+/***********************************************************************/
+void drive(int angle, int power) {
+	const struct diff_wheels *d;
+	int outer, inner;
+
+	if (angle > MAXIMUM_ANGLE) angle = MAXIMUM_ANGLE;
+	if (angle < -MAXIMUM_ANGLE) angle = -MAXIMUM_ANGLE;
+
+	handle(angle);
+	d = &diffWheels[angle + MAXIMUM_ANGLE];
+	outer = fx_mul_int(d->outer, power);
+	inner = fx_mul_int(d->inner, power);
+	if (outer > MOTOR_POWER_MAX || outer < -MOTOR_POWER_MAX) {
+		inner = inner * MOTOR_POWER_MAX / (outer < 0 ? -outer : outer);
+		outer = outer < 0 ? -MOTOR_POWER_MAX : MOTOR_POWER_MAX;
+	}
+	if (angle >= 0) {
+		motor(outer, inner);
+	}
+	else {
+		motor(inner, outer);
+	}
 }
 
 
 /***********************************************************************/
 /* Definition:			                                               */
-/*		Slow down motor bevore curve                                   */
+/*		Start a reverse duty pulse from brakeTable, from the entry     */
+/*		speed down to the target speed                                 */
 /* Arguments:														   */
-/*		time intervall to slow down motor							   */
-/***********************************************************************/													   */
-void slowDownMotorPower_linear(int time) {
-	if (cnt1 <= time) {
-				int timeBetweenEachSlowDownStep = time/(100-CURVE_ENTRANCE_MOTOR_POWER);	
-				int slowDownValue = cnt1/timeBetweenEachSlowDownStep;						
-					
-				if ((100 - slowDownValue) >= CURVE_ENTRANCE_MOTOR_POWER) {
-					actualMotorPower = 100 - slowDownValue;
-				}
-				else{
-					actualMotorPower = CURVE_ENTRANCE_MOTOR_POWER;
-				}
-
-				}
+/*		entry, target: m/s, rounded to BRAKE_SPEED_STEP				   */
+/***********************************************************************/
+void brake_start(fx_t entry, fx_t target) {
+	const struct brake_step *b;
+	int e, t;
+
+	e = fx_to_int(fx_mul(entry, FX(1 / BRAKE_SPEED_STEP)) + FX(0.5));
+	t = fx_to_int(fx_mul(target, FX(1 / BRAKE_SPEED_STEP)) + FX(0.5));
+	e = e < 0 ? 0 : e > BRAKE_SPEEDS - 1 ? BRAKE_SPEEDS - 1 : e;
+	t = t < 0 ? 0 : t > BRAKE_SPEEDS - 1 ? BRAKE_SPEEDS - 1 : t;
+	b = &brakeTable[e * BRAKE_SPEEDS + t];
+	if (b->power == 0) {
+		return;
+	}
+
+	brake.active = 1;
+	brake.power = b->power;
+	brake.ms = b->ms;
+	brake.target = target;
+	timer_start(TIMER_BRAKE, 0, 0);
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Run the brake pulse, every control step. It ends after its     */
+/*		length or once the encoders see the target speed, then speed   */
+/*		control takes over from a clean integral                       */
+/***********************************************************************/
+void brake_update(void) {
+	int w;
+
+	if (!brake.active) {
+		return;
+	}
+	if (timer_elapsed(TIMER_BRAKE) < brake.ms && odometry.speed_avg > brake.target) {
+		motor_output(WHEEL_LEFT, brake.power);
+		motor_output(WHEEL_RIGHT, brake.power);
+		return;
+	}
+
+	brake.active = 0;
+	for (w = 0; w < WHEELS; w++) {
+#if SPEED_CONTROL
+		speedPi[w].integral = 0;
+#else
+		motor_output(w, brake.resume[w]);
+#endif
+	}
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Plan the lane change S curve from the current speed: two arcs  */
+/*		of opposite direction, each LANE_OFFSET_MM / 2 to the side, on  */
+/*		the tightest circle LANE_ACCEL allows (r = v^2 / a), at the    */
+/*		straight line power. Above the speed whose S curve takes       */
+/*		LANE_RUN_MM it brakes to that speed first. The servo lags a    */
+/*		full swing twice as long as half a one, so the second arc is   */
+/*		commanded that much earlier to leave the car straight.         */
+/* Arguments:														   */
+/*		side: 1 right, -1 left										   */
+/***********************************************************************/
+void lane_plan(int side) {
+	long v, vMax, rMin, r, arc;
+	int a;
+	fx_t q;
+
+	lanePlan.power = traceTable[TRACE_00].power;
+
+	/* sqrt(offset r) per arc, LANE_RUN_MM for both: r = (run / 2)^2 / offset */
+	v = fx_mul_int(odometry.speed_avg, 1000);
+	vMax = (long)isqrt((unsigned long)LANE_ACCEL * (LANE_RUN_MM / 2) * (LANE_RUN_MM / 2) / LANE_OFFSET_MM * 1000);
+	if (v > vMax) {
+		brake_start(odometry.speed_avg, fx_div_int((int)vMax, 1000));
+		lanePlan.power = (int)(lanePlan.power * vMax / v);
+		v = vMax;
+	}
+
+	/* Largest angle whose circle is not tighter than v^2 / a */
+	rMin = v * v / (LANE_ACCEL * 1000L);
+	for (a = LANE_ANGLE_MAX; a > 1 && laneRadius[a - 1] < rMin; a--) {
+	}
+	r = laneRadius[a - 1];
+
+	/* Arc length 2 r asin(u), u^2 = offset / 4r: sqrt(offset r) times
+	 * the series 1 + u^2 / 6 + 3 u^4 / 40 */
+	q = fx_div_int(LANE_OFFSET_MM, (int)(4 * r));
+	arc = fx_mul_int(FX_ONE + fx_mul(q, FX_RATIO(1, 6) + fx_mul(q, FX(0.075))),
+					 (int)isqrt((unsigned long)LANE_OFFSET_MM * r));
+	lanePlan.angle = (signed char)(side * a);
+	lanePlan.switch_mm = arc - v * a / (2 * SERVO_SLEW);
+	lanePlan.end_mm = 2 * arc;
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Run the lane change S curve, every control step of pattern     */
+/*		54/64. The first sensor that sees the new lane after the first */
+/*		arc hands over to the normal trace.                            */
+/* Return values:				                                       */
+/*		next pattern, STAY while on the S curve						   */
+/***********************************************************************/
+unsigned char lane_follow(void) {
+	long s = travel_elapsed(TRAVEL_STATE);
+
+	if (s >= lanePlan.switch_mm && sensor_inp(MASK4_4) != 0x00) {
+		led_out(0x0);
+		return 11;
+	}
+	if (s < lanePlan.switch_mm) {
+		drive(lanePlan.angle, lanePlan.power);
+	}
+	else if (s < lanePlan.end_mm) {
+		drive(-lanePlan.angle, lanePlan.power);
+	}
+	else {
+		drive(0, lanePlan.power);
+	}
+	return STAY;
+}
+
+/***********************************************************************/
+/* Definition:			                                               */
+/*		Integer square root, bit by bit                                */
+/* Return values:				                                       */
+/*		floor(sqrt(n))												   */
+/***********************************************************************/
+unsigned long isqrt(unsigned long n) {
+	unsigned long root = 0, bit = 1UL << 30;
+
+	while (bit > n) {
+		bit >>= 2;
+	}
+	while (bit != 0) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
 }
 
 /***********************************************************************/
@@ -0,0 +1,44 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   odometry.h                                 */
+/*  File Contents:          Wheel encoder distance and speed           */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+The rear wheel encoders are counted by MTU1 (left) and MTU2 (right) in
+phase counting mode. odometry_update() runs once per control step: it
+extends the 16 bit counters, and works out the travel of that step and
+the speed averaged over the last ODOMETRY_WINDOW steps, timed with
+timestamp(). Distances and speeds are Q16.16 (fixed.h), except the
+whole mm of travel_mm that travel marks are measured against.
+
+One count is ENCODER_UM_PER_COUNT micrometres of wheel travel, so
+counts * ENCODER_UM_PER_COUNT / us is directly m/s.
+**/
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include "fixed.h"
+#include "hal.h"
+
+#define ENCODER_UM_PER_COUNT	200		// wheel travel per count, um
+#define ODOMETRY_WINDOW			8		// control steps of speed averaging
+
+enum odometry_wheel {
+	WHEEL_LEFT,
+	WHEEL_RIGHT,
+	WHEELS
+};
+
+struct odometry {
+	long counts[WHEELS];		// since power on, forward positive
+	fx_t step_mm[WHEELS];		// travel in the last control step, mm
+	fx_t speed[WHEELS];			// m/s
+	fx_t speed_avg;				// m/s, center of the rear axle
+	long travel_mm;				// center of the rear axle since power on
+};
+
+extern HAL_STATE struct odometry odometry;
+
+#endif /* ODOMETRY_H */
@@ -0,0 +1,42 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   table.h                                    */
+/*  File Contents:          Compile time generated const tables        */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+Repeats an entry macro over a range of indices so lookup tables are
+generated by the preprocessor from the constants they depend on: change
+PWM_CYCLE or SERVO_CENTER and the next build has the new table, with
+nothing to regenerate by hand and no start-up code to fill RAM.
+
+TABLE_N(entry, first) expands to entry(first), entry(first + 1), ...
+N entries, each separated by a comma:
+
+*	#define DOUBLE(i)	((i) * 2)
+*	static const int twice[8] = { TABLE_8(DOUBLE, 0) };
+
+The entry macro must parenthesise its argument, it gets an expression
+like (-100 + 37).
+**/
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#define TABLE_1(e, b)	e((b))
+#define TABLE_2(e, b)	TABLE_1(e, b), TABLE_1(e, (b) + 1)
+#define TABLE_4(e, b)	TABLE_2(e, b), TABLE_2(e, (b) + 2)
+#define TABLE_8(e, b)	TABLE_4(e, b), TABLE_4(e, (b) + 4)
+#define TABLE_16(e, b)	TABLE_8(e, b), TABLE_8(e, (b) + 8)
+#define TABLE_32(e, b)	TABLE_16(e, b), TABLE_16(e, (b) + 16)
+#define TABLE_64(e, b)	TABLE_32(e, b), TABLE_32(e, (b) + 32)
+#define TABLE_128(e, b)	TABLE_64(e, b), TABLE_64(e, (b) + 64)
+#define TABLE_256(e, b)	TABLE_128(e, b), TABLE_128(e, (b) + 128)
+
+/* Odd sizes used by the firmware */
+#define TABLE_91(e, b)	TABLE_64(e, b), TABLE_16(e, (b) + 64), TABLE_8(e, (b) + 80), \
+						TABLE_2(e, (b) + 88), TABLE_1(e, (b) + 90)
+#define TABLE_201(e, b)	TABLE_128(e, b), TABLE_64(e, (b) + 128), TABLE_8(e, (b) + 192), \
+						TABLE_1(e, (b) + 200)
+
+#endif /* TABLE_H */
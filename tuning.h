@@ -0,0 +1,62 @@
+/***********************************************************************/
+/*  Supported Microcontroller:RX62T                                    */
+/*  File:                   tuning.h                                   */
+/*  File Contents:          Hand-tuned steering/motor values           */
+/*  Version number:         Ver.1.00                                   */
+/***********************************************************************/
+/*
+The normal trace (pattern 11) reacts to each masked sensor pattern with
+one servo angle and one motor power; drive() splits the power between
+the wheels by the steering geometry. The values live in traceTable
+instead of the switch so host tools (host/kit12_sweep.c) can tune them
+on the simulator; on target the table is const and stays in ROM.
+
+Rows are named after the sensor_inp(MASK3_3) value they answer.
+
+With LINE_PD the angle column is unused: the servo follows a PD
+controller on the estimated line offset, with the gains of steerGain
+interpolated for the current speed. kit12_sweep tunes whichever of the
+two steers.
+**/
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#include "fixed.h"
+#include "hal.h"
+
+/* Normal trace steering. 1: PD on the line estimate (steerGain), 0: traceTable angles */
+#define LINE_PD			1
+
+enum trace_row {
+	TRACE_00,			// center -> straight
+	TRACE_04,			// slight amount left of center
+	TRACE_06,			// small amount left of center
+	TRACE_07,			// medium amount left of center
+	TRACE_03,			// large amount left of center
+	TRACE_20,			// slight amount right of center
+	TRACE_60,			// small amount right of center
+	TRACE_E0,			// medium amount right of center
+	TRACE_C0,			// large amount right of center
+	TRACE_01,			// outermost right sensor only
+	TRACE_ROWS
+};
+
+struct trace_step {
+	int angle;			// handle(), clamped to MAXIMUM_ANGLE
+	int power;			// drive() rear axle center, -100 to 100
+};
+
+extern HAL_TUNABLE struct trace_step traceTable[TRACE_ROWS];
+
+/* One row per m/s of odometry speed, 0 to STEER_GAIN_ROWS - 1 m/s */
+#define STEER_GAIN_ROWS	4
+
+struct steer_gain {
+	fx_t kp;			// handle() degrees per mm of line offset
+	fx_t kd;			// handle() degrees per mm/s of line offset rate
+};
+
+extern HAL_TUNABLE struct steer_gain steerGain[STEER_GAIN_ROWS];
+
+#endif /* TUNING_H */